@@ -0,0 +1,328 @@
+/*
+* calculator.cpp computes one pair per call, and every call goes through
+* `switch (op)` again, although op never changes. Applied to millions of pairs:
+* one branch per pair, and a loop the compiler cannot vectorize because the
+* operation is only known inside the loop.
+*
+* The batch version `calculate(a, b, out)` turns this inside out:
+* - the switch runs once per batch, picking one loop per operation,
+* - each loop is an AVX2 'kernel' that computes 8 pairs per instruction
+*   (plus a scalar tail for the last size % 8 pairs).
+*
+* Division is the odd one: x86 has no SIMD instruction for integer division.
+* - When the divisor differs per pair, the kernel converts to double and
+*   divides 4 lanes at a time. This is exact: a 32 bit quotient rounded to 53
+*   bits never crosses an integer, so truncating it gives the same result as /.
+* - When all pairs share one divisor (`calculate(a, divisor, out)`), the
+*   division is replaced by a multiplication with a precomputed 'magic number'
+*   and a shift (Granlund & Montgomery; Hacker's Delight, chapter 10). The
+*   magic number is computed once per batch, which is what compilers do for
+*   `x / 7` with a constant 7.
+*
+* As with the scalar version, b must not be 0 (checked once for the shared
+* divisor), and INT_MIN / -1 is not defined.
+*
+* compile: `g++ -std=c++20 -O2 -mavx2 calculator_batch.cpp -o calculator_batch`
+* (without -mavx2 the batch loops are plain scalar loops, still without the
+* per-pair switch.)
+*/
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Same as calculator.cpp.
+enum class Operation {
+    Add,
+    Sub,
+    Mul,
+    Div
+};
+
+// q = n / d as q = ((n * multiplier) >> (32 + shift)) + (1 if that is negative),
+// with fix-ups for the sign of the multiplier. Valid for any d except 0.
+struct MagicDivisor {
+    int32_t divisor;
+    int32_t multiplier;
+    int shift;
+
+    explicit MagicDivisor(int32_t d) : divisor{ d }, multiplier{}, shift{} {
+        if (d == 0) throw std::domain_error{ "Division by zero." };
+        if (d == 1 || d == -1) return;  // no magic needed, see divide()
+        // Hacker's Delight, figure 10-1.
+        const uint32_t two31{ 0x8000'0000u };
+        const uint32_t ad = d < 0 ? 0u - static_cast<uint32_t>(d) : static_cast<uint32_t>(d);
+        const uint32_t t = two31 + (static_cast<uint32_t>(d) >> 31);
+        const uint32_t anc = t - 1 - t % ad;  // |nc|, the largest n with n % d == d - 1
+        int p{ 31 };
+        uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+        uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+        uint32_t delta{};
+        do {
+            p++;
+            q1 *= 2; r1 *= 2;
+            if (r1 >= anc) { q1++; r1 -= anc; }
+            q2 *= 2; r2 *= 2;
+            if (r2 >= ad) { q2++; r2 -= ad; }
+            delta = ad - r2;
+        } while (q1 < delta || (q1 == delta && r1 == 0));
+        const uint32_t m = q2 + 1;
+        multiplier = static_cast<int32_t>(d < 0 ? 0u - m : m);
+        shift = p - 32;
+    }
+
+    int32_t divide(int32_t n) const {
+        if (divisor == 1) return n;
+        if (divisor == -1) return static_cast<int32_t>(0u - static_cast<uint32_t>(n));
+        int32_t q = static_cast<int32_t>((int64_t{ multiplier } * n) >> 32);
+        if (divisor > 0 && multiplier < 0) q += n;
+        if (divisor < 0 && multiplier > 0) q -= n;
+        q >>= shift;
+        return q + static_cast<int32_t>(static_cast<uint32_t>(q) >> 31);
+    }
+
+#ifdef __AVX2__
+    __m256i divide(__m256i n) const {
+        if (divisor == 1) return n;
+        if (divisor == -1) return _mm256_sub_epi32(_mm256_setzero_si256(), n);
+        // High 32 bits of the 8 signed 32x32 bit products: even lanes, then odd lanes.
+        const __m256i m = _mm256_set1_epi32(multiplier);
+        const __m256i even = _mm256_srli_epi64(_mm256_mul_epi32(n, m), 32);
+        const __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(n, 32), m);
+        __m256i q = _mm256_blend_epi32(even, odd, 0b1010'1010);
+        if (divisor > 0 && multiplier < 0) q = _mm256_add_epi32(q, n);
+        if (divisor < 0 && multiplier > 0) q = _mm256_sub_epi32(q, n);
+        q = _mm256_srai_epi32(q, shift);
+        return _mm256_add_epi32(q, _mm256_srli_epi32(q, 31));
+    }
+#endif
+};
+
+// One kernel per operation: 8 lanes at a time, and one pair at a time for the tail.
+struct AddKernel {
+    int scalar(int x, int y) const { return x + y; }
+#ifdef __AVX2__
+    __m256i vector(__m256i x, __m256i y) const { return _mm256_add_epi32(x, y); }
+#endif
+};
+
+struct SubKernel {
+    int scalar(int x, int y) const { return x - y; }
+#ifdef __AVX2__
+    __m256i vector(__m256i x, __m256i y) const { return _mm256_sub_epi32(x, y); }
+#endif
+};
+
+struct MulKernel {
+    int scalar(int x, int y) const { return x * y; }
+#ifdef __AVX2__
+    __m256i vector(__m256i x, __m256i y) const { return _mm256_mullo_epi32(x, y); }
+#endif
+};
+
+struct DivKernel {
+    int scalar(int x, int y) const { return x / y; }
+#ifdef __AVX2__
+    // Through double, 4 lanes at a time.
+    __m256i vector(__m256i x, __m256i y) const {
+        const __m128i lo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)),
+                                                             _mm256_cvtepi32_pd(_mm256_castsi256_si128(y))));
+        const __m128i hi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)),
+                                                             _mm256_cvtepi32_pd(_mm256_extracti128_si256(y, 1))));
+        return _mm256_set_m128i(hi, lo);
+    }
+#endif
+};
+
+// Division by the divisor it was made for, whatever y says.
+struct MagicDivKernel {
+    MagicDivisor divisor;
+    int scalar(int x, int) const { return divisor.divide(x); }
+#ifdef __AVX2__
+    __m256i vector(__m256i x, __m256i) const { return divisor.divide(x); }
+#endif
+};
+
+// out[i] = kernel(a[i], b[i]), where `b` is either a span (one b per pair) or
+// an int (the same b for all pairs).
+template <typename Kernel, typename B>
+void for_each_pair(std::span<const int> a, const B& b, std::span<int> out, const Kernel& kernel) {
+    constexpr bool shared_b = std::is_same_v<B, int>;
+    size_t i{};
+#ifdef __AVX2__
+    [[maybe_unused]] __m256i vb{};
+    if constexpr (shared_b) vb = _mm256_set1_epi32(b);
+    for (; i + 8 <= a.size(); i += 8) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a.data() + i));
+        if constexpr (!shared_b) vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b.data() + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + i), kernel.vector(va, vb));
+    }
+#endif
+    for (; i < a.size(); i++) {
+        if constexpr (shared_b) out[i] = kernel.scalar(a[i], b);
+        else out[i] = kernel.scalar(a[i], b[i]);
+    }
+}
+
+class Calculator
+{
+private:
+    Operation op;
+public:
+    Calculator(Operation op_input) {
+        op = op_input;
+    }
+    // Same as calculator.cpp.
+    int calculate(int a, int b) {
+        switch (op)
+        {
+        case Operation::Add: {
+            return a+b;
+            printf("doing addition.");
+        } break;
+        case Operation::Sub:
+            return a-b;
+            break;
+        case Operation::Mul:
+            return a*b;
+            break;
+        case Operation::Div:
+            return a/b;
+            break;
+        }
+        return 0;
+    }
+
+    // out[i] = a[i] op b[i]. The switch runs once, not once per pair.
+    void calculate(std::span<const int> a, std::span<const int> b, std::span<int> out) {
+        if (a.size() != b.size() || a.size() != out.size()) throw std::length_error{ "Spans must have the same size." };
+        switch (op)
+        {
+        case Operation::Add:
+            for_each_pair(a, b, out, AddKernel{});
+            break;
+        case Operation::Sub:
+            for_each_pair(a, b, out, SubKernel{});
+            break;
+        case Operation::Mul:
+            for_each_pair(a, b, out, MulKernel{});
+            break;
+        case Operation::Div:
+            for_each_pair(a, b, out, DivKernel{});
+            break;
+        }
+    }
+
+    // out[i] = a[i] op b, one b for all pairs. Div uses a magic number.
+    void calculate(std::span<const int> a, int b, std::span<int> out) {
+        if (a.size() != out.size()) throw std::length_error{ "Spans must have the same size." };
+        switch (op)
+        {
+        case Operation::Add:
+            for_each_pair(a, b, out, AddKernel{});
+            break;
+        case Operation::Sub:
+            for_each_pair(a, b, out, SubKernel{});
+            break;
+        case Operation::Mul:
+            for_each_pair(a, b, out, MulKernel{});
+            break;
+        case Operation::Div:
+            for_each_pair(a, b, out, MagicDivKernel{ MagicDivisor{ b } });
+            break;
+        }
+    }
+};
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+const char* name_of(Operation op) {
+    const char* names[]{ "Add", "Sub", "Mul", "Div" };
+    return names[static_cast<int>(op)];
+}
+
+int main(int argc, char** argv) {
+    Calculator calculator {Operation::Sub};
+    printf("Result is: %d\n", calculator.calculate(10, 20));
+    const int a3[]{ 10, 20, 30 }, b3[]{ 20, 5, -7 };
+    int out3[3];
+    calculator.calculate(a3, b3, out3);
+    printf("Batch result is: %d %d %d\n", out3[0], out3[1], out3[2]);
+
+    // The magic numbers against /, for awkward divisors and dividends.
+    const int divisors[]{ 1, -1, 2, -2, 3, -3, 7, 10, -10, 641, 1 << 30, INT32_MAX, -INT32_MAX, INT32_MIN };
+    const int dividends[]{ 0, 1, -1, 6, -6, 7, -7, 1000, -1000, INT32_MAX, -INT32_MAX, INT32_MIN + 1 };
+    size_t wrong{};
+    for (int d : divisors)
+        for (int n : dividends) wrong += MagicDivisor{ d }.divide(n) != n / d;
+    uint32_t x{ 12345 };
+    for (int i{}; i < 1'000'000; i++) {
+        x = x * 1664525u + 1013904223u;
+        const int d = static_cast<int>(x) >> (x % 31);  // divisors of every size
+        x = x * 1664525u + 1013904223u;
+        const int n = static_cast<int>(x);
+        if (d != 0 && !(d == -1 && n == INT32_MIN)) wrong += MagicDivisor{ d }.divide(n) != n / d;
+    }
+    printf("magic division: %zu wrong results\n", wrong);
+
+    // Operands in L2 cache, so the numbers show the loops, not the memory.
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 16384;
+    const size_t rounds{ 100'000'000 / n + 1 };
+    std::vector<int> a(n), b(n), out(n), expected(n);
+    for (size_t i{}; i < n; i++) {
+        x = x * 1664525u + 1013904223u;
+        a[i] = static_cast<int>(x >> 12) - (1 << 19);  // small enough that a * b does not overflow
+        x = x * 1664525u + 1013904223u;
+        b[i] = static_cast<int>(x >> 20) - 2048;
+        if (b[i] == 0) b[i] = 1;
+    }
+
+    printf("\n=== %zu pairs x %zu rounds, ns per pair ===\n", n, rounds);
+    printf("%-4s %12s %12s %12s %12s\n", "", "scalar", "batch", "scalar b=7", "batch b=7");
+    for (Operation op : { Operation::Add, Operation::Sub, Operation::Mul, Operation::Div }) {
+        Calculator calculator{ op };
+        // calculate(int, int) as it is used today: one call, one switch per pair.
+        const double t_scalar = milliseconds([&] {
+            for (size_t r{}; r < rounds; r++)
+                for (size_t i{}; i < n; i++) expected[i] = calculator.calculate(a[i], b[i]);
+        });
+        const double t_batch = milliseconds([&] {
+            for (size_t r{}; r < rounds; r++) calculator.calculate(a, b, out);
+        });
+        wrong = 0;
+        for (size_t i{}; i < n; i++) wrong += out[i] != expected[i];
+
+        const double t_scalar_7 = milliseconds([&] {
+            for (size_t r{}; r < rounds; r++)
+                for (size_t i{}; i < n; i++) expected[i] = calculator.calculate(a[i], 7);
+        });
+        const double t_batch_7 = milliseconds([&] {
+            for (size_t r{}; r < rounds; r++) calculator.calculate(a, 7, out);
+        });
+        for (size_t i{}; i < n; i++) wrong += out[i] != expected[i];
+
+        const double per_pair = 1e6 / (static_cast<double>(n) * rounds);
+        printf("%-4s %12.3f %12.3f %12.3f %12.3f %s\n", name_of(op), t_scalar * per_pair, t_batch * per_pair,
+               t_scalar_7 * per_pair, t_batch_7 * per_pair, wrong ? "MISMATCH" : "");
+    }
+    return 0;
+}
+
+/* TAKEAWAY
+* A switch on a value that does not change belongs outside the loop: then each
+* loop does one thing, and one thing is what SIMD is good at. Division has no
+* SIMD instruction, but a divisor known before the loop turns it into a
+* multiplication.
+*/
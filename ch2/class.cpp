@@ -14,6 +14,8 @@
 #include <cstdio>
 #include <cstdint>
 
+#include "struct_layout.h"
+
 class ClockOfTheLongNow {
     int year;
 
@@ -37,6 +39,19 @@ public:
     int get_year() {return year;}
 };
 
+// A struct that only holds data; see main. Outside of main so that its layout
+// budget can be checked (see struct_layout.h).
+struct PodStruct
+{
+    uint64_t number;
+    char string[256];
+    bool valid;
+};
+template <>
+constexpr auto fields_of<PodStruct> = std::array{
+    FIELD(PodStruct, number), FIELD(PodStruct, string), FIELD(PodStruct, valid) };
+static_assert(within_budget<PodStruct>(272, 7), "PodStruct grew.");
+
 int main() {
     ClockOfTheLongNow clock;
     if (!clock.set_year(2018)) {
@@ -49,13 +64,6 @@ int main() {
     ClockOfTheLongNow anotherclock{ 2021 };
     printf("Year is: %d\n", anotherclock.get_year());
 
-    struct PodStruct
-    {
-        uint64_t number;
-        char string[256];
-        bool valid;
-    };
-
     // braced initialization is the way to go.
     PodStruct pod1{};
     printf("uninitialized struct: %llu\t%s\t%d\n", pod1.number, pod1.string, pod1.valid);
@@ -0,0 +1,429 @@
+/*
+* Calculator (calculator.cpp) applies one Operation to two ints. A formula like
+* `(a+b)*c-d` over many rows is several Operations chained together, and
+* walking a syntax tree per row pays for the walk (pointer chasing, a switch per
+* node, recursion) on every single row.
+*
+* This file compiles the formula once into 'bytecode' over the same Operation
+* enum, and runs it on a small 'register machine' (VM):
+*
+* 1. Parsing builds a DAG of nodes (a tree in which equal subtrees are one
+*    node). Two optimizations happen while it is built:
+*    - 'constant folding': an Operation on two constants is computed right
+*      away, `2*3` becomes `6`, and `x*1`, `x+0`, `x-0`, `x/1` become `x`,
+*    - 'common subexpression elimination' (CSE): a node that already exists is
+*      reused instead of created again, so `(a+b)*(a+b)` computes `a+b` once.
+*      Add and Mul sort their operands first, so `b+a` is found as `a+b` too.
+* 2. Code generation emits one Instruction per node, `r = left op right`, where
+*    left and right are a column, a constant or a register. A register is
+*    reused as soon as its last reader is done, so few registers are needed.
+* 3. The VM runs 'column at a time': the rows are cut into batches of 1024,
+*    and a register holds one value per row of the batch. Each instruction is
+*    decoded once per batch and then runs a tight loop over 1024 rows, so the
+*    dispatch cost is paid per batch instead of per row, and the loops are
+*    simple enough for the compiler to vectorize.
+*
+* Add, Sub and Mul wrap around on overflow (they compute in unsigned), which
+* is what calculator.cpp does in practice. Division by zero and INT_MIN / -1
+* (not defined, as with /) are checked once per batch and throw.
+*
+* compile: `g++ -std=c++20 -O3 expression_vm.cpp -o expression_vm`
+* (-O3, because GCC 12 only vectorizes the kernel loops from -O3 on.)
+*/
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// Same as calculator.cpp.
+enum class Operation {
+    Add,
+    Sub,
+    Mul,
+    Div
+};
+
+// Where an operand comes from.
+struct Source {
+    enum class Kind : uint8_t { Column, Constant, Register } kind;
+    uint8_t index;
+};
+
+// registers[destination] = left op right
+struct Instruction {
+    Operation op;
+    uint8_t destination;
+    Source left, right;
+};
+
+class Formula {
+public:
+    static constexpr size_t batch_size{ 1024 };
+
+    // `optimize` = false turns off constant folding and CSE, for comparison.
+    Formula(std::string_view text, std::span<const std::string_view> column_names, bool optimize = true)
+        : text{ text }, optimize{ optimize }, column_names(column_names.begin(), column_names.end()) {
+        if (column_names.size() > UINT8_MAX + 1) throw std::runtime_error{ "Too many columns for a formula." };
+        const uint32_t root = parse_expression();
+        skip_spaces();
+        if (position != text.size()) throw std::runtime_error{ "Unexpected '" + std::string{ text[position] } + "' in formula." };
+        generate(root);
+    }
+
+    // out[row] = formula(columns[0][row], columns[1][row], ...), batch by batch.
+    // `out` must not overlap a column: it also holds temporaries.
+    void evaluate(std::span<const std::span<const int>> columns, std::span<int> out, size_t batch = batch_size) const {
+        if (batch == 0) throw std::invalid_argument{ "Batch size must not be 0." };
+        if (columns.size() != column_names.size()) throw std::length_error{ "Wrong number of columns." };
+        for (const auto& column : columns) {
+            if (column.size() != out.size()) throw std::length_error{ "Columns must have the same size." };
+            if (out.data() < column.data() + column.size() && column.data() < out.data() + out.size())
+                throw std::invalid_argument{ "Output must not overlap an input column." };
+        }
+        if (code.empty()) {  // the formula is a single column or constant
+            for (size_t row{}; row < out.size(); row++) out[row] = result.kind == Source::Kind::Column ? columns[result.index][row] : constants[0];
+            return;
+        }
+        // Registers and broadcast constants, allocated once for all batches.
+        std::vector<int> scratch((n_registers + constants.size()) * batch);
+        int* constant_columns = scratch.data() + n_registers * batch;
+        for (size_t k{}; k < constants.size(); k++) std::fill_n(constant_columns + k * batch, batch, constants[k]);
+        std::vector<int*> registers(n_registers);
+
+        for (size_t first{}; first < out.size(); first += batch) {
+            const size_t n = std::min(batch, out.size() - first);
+            for (size_t r{}; r < n_registers; r++) registers[r] = scratch.data() + r * batch;
+            registers[result.index] = out.data() + first;  // the last instruction writes the result in place
+            const auto address = [&](Source source) -> const int* {
+                switch (source.kind) {
+                case Source::Kind::Column: return columns[source.index].data() + first;
+                case Source::Kind::Constant: return constant_columns + source.index * batch;
+                case Source::Kind::Register: return registers[source.index];
+                }
+                return nullptr;
+            };
+            for (const Instruction& instruction : code) {
+                run(instruction.op, registers[instruction.destination], address(instruction.left), address(instruction.right), n);
+            }
+        }
+    }
+
+    // The bytecode, one line per instruction.
+    void print() const {
+        for (const Instruction& instruction : code) {
+            const char symbols[]{ '+', '-', '*', '/' };
+            printf("    r%d = %s %c %s\n", instruction.destination, name(instruction.left).c_str(),
+                   symbols[static_cast<int>(instruction.op)], name(instruction.right).c_str());
+        }
+        if (code.empty()) printf("    %s\n", name(result).c_str());
+    }
+
+    size_t instruction_count() const { return code.size(); }
+    size_t register_count() const { return n_registers; }
+
+private:
+    // One node of the DAG. For Column and Constant nodes, `value` is the
+    // column index or the constant; for Register nodes (results of an
+    // Operation), left and right are node ids.
+    struct Node {
+        Source::Kind kind;
+        Operation op;
+        int value;
+        uint32_t left, right;
+    };
+
+    // The kernels: one tight loop per Operation.
+    static void run(Operation op, int* out, const int* a, const int* b, size_t n) {
+        switch (op)
+        {
+        case Operation::Add:
+            for (size_t i{}; i < n; i++) out[i] = static_cast<int>(static_cast<unsigned>(a[i]) + static_cast<unsigned>(b[i]));
+            break;
+        case Operation::Sub:
+            for (size_t i{}; i < n; i++) out[i] = static_cast<int>(static_cast<unsigned>(a[i]) - static_cast<unsigned>(b[i]));
+            break;
+        case Operation::Mul:
+            for (size_t i{}; i < n; i++) out[i] = static_cast<int>(static_cast<unsigned>(a[i]) * static_cast<unsigned>(b[i]));
+            break;
+        case Operation::Div: {
+            bool zero{}, overflow{};
+            for (size_t i{}; i < n; i++) {
+                zero |= b[i] == 0;
+                overflow |= (a[i] == INT32_MIN) & (b[i] == -1);
+            }
+            if (zero) throw std::runtime_error{ "Division by zero." };
+            if (overflow) throw std::runtime_error{ "Overflow in division." };
+            for (size_t i{}; i < n; i++) out[i] = a[i] / b[i];
+        } break;
+        }
+    }
+
+    // Returns the id of an equal node if there is one (CSE), or adds it.
+    uint32_t add_node(Node node) {
+        const auto key = std::tuple{ node.kind, node.op, node.value, node.left, node.right };
+        if (optimize) {
+            if (const auto found = node_ids.find(key); found != node_ids.end()) return found->second;
+        }
+        nodes.push_back(node);
+        const auto id = static_cast<uint32_t>(nodes.size() - 1);
+        node_ids[key] = id;
+        return id;
+    }
+
+    uint32_t constant(int value) { return add_node({ Source::Kind::Constant, Operation::Add, value, 0, 0 }); }
+
+    uint32_t operation(Operation op, uint32_t left, uint32_t right) {
+        if (optimize) {
+            const Node& l = nodes[left];
+            const Node& r = nodes[right];
+            const bool l_constant = l.kind == Source::Kind::Constant, r_constant = r.kind == Source::Kind::Constant;
+            if (r_constant && r.value == 0 && op == Operation::Div) throw std::runtime_error{ "Division by zero in formula." };
+            if (l_constant && r_constant) {
+                const auto a = static_cast<unsigned>(l.value), b = static_cast<unsigned>(r.value);
+                switch (op) {
+                case Operation::Add: return constant(static_cast<int>(a + b));
+                case Operation::Sub: return constant(static_cast<int>(a - b));
+                case Operation::Mul: return constant(static_cast<int>(a * b));
+                case Operation::Div:
+                    if (l.value == INT32_MIN && r.value == -1) throw std::runtime_error{ "Overflow in formula." };
+                    return constant(l.value / r.value);
+                }
+            }
+            const bool add_or_mul = op == Operation::Add || op == Operation::Mul;
+            const int neutral = op == Operation::Add || op == Operation::Sub ? 0 : 1;
+            if (r_constant && r.value == neutral) return left;
+            if (l_constant && l.value == neutral && add_or_mul) return right;
+            if (add_or_mul && left > right) std::swap(left, right);
+        }
+        return add_node({ Source::Kind::Register, op, 0, left, right });
+    }
+
+    void skip_spaces() {
+        while (position < text.size() && text[position] == ' ') position++;
+    }
+
+    bool accept(char c) {
+        skip_spaces();
+        if (position < text.size() && text[position] == c) {
+            position++;
+            return true;
+        }
+        return false;
+    }
+
+    // expression = term { ('+' | '-') term }
+    uint32_t parse_expression() {
+        uint32_t left = parse_term();
+        for (;;) {
+            if (accept('+')) left = operation(Operation::Add, left, parse_term());
+            else if (accept('-')) left = operation(Operation::Sub, left, parse_term());
+            else return left;
+        }
+    }
+
+    // term = factor { ('*' | '/') factor }
+    uint32_t parse_term() {
+        uint32_t left = parse_factor();
+        for (;;) {
+            if (accept('*')) left = operation(Operation::Mul, left, parse_factor());
+            else if (accept('/')) left = operation(Operation::Div, left, parse_factor());
+            else return left;
+        }
+    }
+
+    // factor = number | column | '(' expression ')' | '-' factor
+    // '(' and '-' recurse; the formula comes from the user, so the nesting is
+    // limited before the stack runs out.
+    uint32_t parse_factor() {
+        if (accept('(')) {
+            if (++depth > max_depth) throw std::runtime_error{ "Formula is nested too deeply." };
+            const uint32_t inner = parse_expression();
+            if (!accept(')')) throw std::runtime_error{ "Missing ')' in formula." };
+            depth--;
+            return inner;
+        }
+        if (accept('-')) {
+            if (++depth > max_depth) throw std::runtime_error{ "Formula is nested too deeply." };
+            const uint32_t zero = constant(0);
+            const uint32_t negated = operation(Operation::Sub, zero, parse_factor());
+            depth--;
+            return negated;
+        }
+        skip_spaces();
+        const size_t start{ position };
+        if (position < text.size() && text[position] >= '0' && text[position] <= '9') {
+            int value{};
+            const auto [end, error] = std::from_chars(text.data() + position, text.data() + text.size(), value);
+            if (error != std::errc{}) throw std::runtime_error{ "Number too large in formula." };
+            position = static_cast<size_t>(end - text.data());
+            return constant(value);
+        }
+        while (position < text.size() && (std::isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_')) position++;
+        const std::string_view word = text.substr(start, position - start);
+        if (word.empty()) throw std::runtime_error{ "Expected a number, a column or '(' in formula." };
+        const auto column = std::find(column_names.begin(), column_names.end(), word);
+        if (column == column_names.end()) throw std::runtime_error{ "Unknown column '" + std::string{ word } + "' in formula." };
+        return add_node({ Source::Kind::Column, Operation::Add, static_cast<int>(column - column_names.begin()), 0, 0 });
+    }
+
+    // Emits the nodes that `root` needs, in order, with registers reused after
+    // their last reader.
+    void generate(uint32_t root) {
+        std::vector<bool> needed(nodes.size());
+        needed[root] = true;
+        std::vector<uint32_t> last_reader(nodes.size());
+        for (uint32_t id = root + 1; id-- > 0;) {
+            if (!needed[id] || nodes[id].kind != Source::Kind::Register) continue;
+            for (uint32_t operand : { nodes[id].left, nodes[id].right }) {
+                needed[operand] = true;
+                last_reader[operand] = std::max(last_reader[operand], id);
+            }
+        }
+
+        std::vector<Source> sources(nodes.size());
+        std::vector<bool> in_use;
+        for (uint32_t id{}; id <= root; id++) {
+            if (!needed[id]) continue;
+            const Node& node = nodes[id];
+            if (node.kind == Source::Kind::Column) {
+                sources[id] = { Source::Kind::Column, static_cast<uint8_t>(node.value) };
+            } else if (node.kind == Source::Kind::Constant) {
+                if (constants.size() > UINT8_MAX) throw std::runtime_error{ "Too many constants in formula." };
+                sources[id] = { Source::Kind::Constant, static_cast<uint8_t>(constants.size()) };
+                constants.push_back(node.value);
+            } else {
+                // Operands read for the last time free their registers first,
+                // so the result can go into one of them.
+                for (uint32_t operand : { node.left, node.right }) {
+                    if (sources[operand].kind == Source::Kind::Register && last_reader[operand] == id) in_use[sources[operand].index] = false;
+                }
+                const auto free = std::find(in_use.begin(), in_use.end(), false);
+                const auto r = static_cast<size_t>(free - in_use.begin());
+                if (free == in_use.end()) in_use.push_back(true);
+                else *free = true;
+                if (r > UINT8_MAX) throw std::runtime_error{ "Formula needs too many registers." };
+                sources[id] = { Source::Kind::Register, static_cast<uint8_t>(r) };
+                code.push_back({ node.op, static_cast<uint8_t>(r), sources[node.left], sources[node.right] });
+            }
+        }
+        result = sources[root];
+        n_registers = in_use.size();
+    }
+
+    std::string name(Source source) const {
+        switch (source.kind) {
+        case Source::Kind::Column: return std::string{ column_names[source.index] };
+        case Source::Kind::Constant: return std::to_string(constants[source.index]);
+        case Source::Kind::Register: {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "r%d", source.index);
+            return buffer;
+        }
+        }
+        return {};
+    }
+
+    // Used while compiling.
+    std::string_view text;
+    size_t position{};
+    static constexpr size_t max_depth{ 256 };
+    size_t depth{};
+    bool optimize;
+    std::vector<Node> nodes;
+    std::map<std::tuple<Source::Kind, Operation, int, uint32_t, uint32_t>, uint32_t> node_ids;
+
+    // The program.
+    std::vector<std::string_view> column_names;
+    std::vector<Instruction> code;
+    std::vector<int> constants;
+    Source result{};
+    size_t n_registers{};
+};
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const std::string_view names[]{ "a", "b", "c", "d" };
+    const char* formulas[]{ "(a+b)*c-d", "(a+b)*(b+a) - (a+b)*c + 2*3*d", "(a*1+0) / (4-2) - -c", "-(2*3)", "x+1", "a/(1-1)" };
+    for (const char* text : formulas) {
+        try {
+            const Formula formula{ text, names };
+            const Formula plain{ text, names, false };
+            printf("%s: %zu instructions, %zu registers (without folding and CSE: %zu, %zu)\n", text,
+                   formula.instruction_count(), formula.register_count(), plain.instruction_count(), plain.register_count());
+            formula.print();
+        } catch (const std::runtime_error& e) {
+            printf("%s: %s\n", text, e.what());
+        }
+    }
+
+    const size_t n{ 10'000'000 };
+    std::vector<int> a(n), b(n), c(n), d(n), out(n), expected(n);
+    uint32_t x{ 12345 };
+    for (auto* column : { &a, &b, &c, &d }) {
+        for (int& value : *column) {
+            x = x * 1664525u + 1013904223u;
+            value = static_cast<int>(x >> 21) - 1024;
+        }
+    }
+    const std::span<const int> columns[]{ a, b, c, d };
+
+    const char* text = formulas[1];
+    const Formula formula{ text, names };
+    const Formula plain{ text, names, false };
+    const double t_hand = milliseconds([&] {
+        for (size_t i{}; i < n; i++) expected[i] = (a[i] + b[i]) * (b[i] + a[i]) - (a[i] + b[i]) * c[i] + 2 * 3 * d[i];
+    });
+    size_t wrong{};
+    const auto check = [&] {
+        for (size_t i{}; i < n; i++) wrong += out[i] != expected[i];
+    };
+    const double t_row = milliseconds([&] { formula.evaluate(columns, out, 1); });
+    check();
+    const double t_plain = milliseconds([&] { plain.evaluate(columns, out); });
+    check();
+    const double t_batch = milliseconds([&] { formula.evaluate(columns, out); });
+    check();
+
+    printf("\n=== %s, %zu rows, ns per row ===\n", text, n);
+    printf("%-44s %8.2f\n", "VM, one row at a time", t_row * 1e6 / n);
+    printf("%-44s %8.2f\n", "VM, batches of 1024, no folding and CSE", t_plain * 1e6 / n);
+    printf("%-44s %8.2f\n", "VM, batches of 1024", t_batch * 1e6 / n);
+    printf("%-44s %8.2f\n", "hand-written C++ loop", t_hand * 1e6 / n);
+    printf("%s\n", wrong ? "MISMATCH" : "all results match");
+
+    // Checked while evaluating: INT_MIN / -1, and an output that is an input.
+    std::vector<int> left{ INT32_MIN, 7 }, right{ -1, 2 }, result(2);
+    const std::span<const int> small[]{ left, right, right, right };
+    try {
+        Formula{ "a/b", names }.evaluate(small, result);
+    } catch (const std::runtime_error& e) {
+        printf("a/b: %s\n", e.what());
+    }
+    try {
+        Formula{ "(a+b)*(a-b)", names }.evaluate(small, left);
+    } catch (const std::invalid_argument& e) {
+        printf("(a+b)*(a-b) into a: %s\n", e.what());
+    }
+    return 0;
+}
+
+/* TAKEAWAY
+* Interpreting is slow when the interpreter runs once per value. Run it once
+* per batch of values instead, and the inner loops are as plain as hand-written
+* code; what is left of the interpreter overhead is spread over 1024 rows.
+*/
@@ -0,0 +1,64 @@
+/*
+* builtin_types_and_sizeof.cpp prints sizeof by hand. For structs, sizeof alone
+* does not tell the whole story: the compiler inserts 'padding' bytes so that
+* every member starts at a multiple of its alignment, and pads the end so that
+* arrays of the struct stay aligned. Those bytes are loaded into the cache like
+* any other, so a badly ordered struct costs memory bandwidth.
+*
+* struct_layout.h is a small reusable layout audit:
+* - list the members of a struct once with FIELD(Type, member),
+* - static_assert a size/padding budget next to it, so a layout change that
+*   grows the struct breaks the build instead of silently slowing things down,
+* - print size, alignment, offset of every member and every padding hole,
+* - show what the size would be with members ordered largest alignment first
+*   (the 'rule of thumb' from user_defined_type.cpp).
+*
+* The structs that are walked in bulk have a budget where they are defined:
+* Book (user_defined_type.cpp), PodStruct (class.cpp), Element
+* (ch3/5_linked_lists.cpp) and College (ch3/array_and_pointer.cpp). This
+* file prints their layout from those definitions: it includes the examples
+* themselves, with their main renamed.
+*
+* The report (x86-64 Linux) is in struct_layout_report.txt: this member view
+* plus size and alignment of every struct and class of the repo, taken from
+* g++ -fdump-lang-class. To regenerate it:
+* `./struct_layout_report.sh > struct_layout_report.txt`.
+*
+* compile: `g++ -std=c++20 struct_layout.cpp -o layout`
+*/
+#include "struct_layout.h"
+
+#define main user_defined_type_main
+#include "user_defined_type.cpp"
+#undef main
+#define main class_main
+#include "class.cpp"
+#undef main
+#define main linked_lists_main
+#include "../ch3/5_linked_lists.cpp"
+#undef main
+#define main array_and_pointer_main
+#include "../ch3/array_and_pointer.cpp"
+#undef main
+
+// A deliberately bad order, to show what the audit catches.
+struct Badly {
+    bool a;
+    double b;
+    bool c;
+    int d;
+    bool e;
+};
+template <>
+constexpr auto fields_of<Badly> = std::array{
+    FIELD(Badly, a), FIELD(Badly, b), FIELD(Badly, c), FIELD(Badly, d), FIELD(Badly, e) };
+// static_assert(within_budget<Badly>(16, 4), "Badly grew.");  // Bang! 32 bytes, 17 of padding
+
+int main() {
+    print_layout<Book>("Book");
+    print_layout<PodStruct>("PodStruct");
+    print_layout<Element>("Element");
+    print_layout<College>("College");
+    print_layout<Badly>("Badly");
+    return 0;
+}
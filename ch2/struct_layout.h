@@ -0,0 +1,83 @@
+/*
+* Layout audit for the structs of the examples (see struct_layout.cpp).
+*
+* Next to the struct, list its members once and give it a budget:
+*
+*   #include "struct_layout.h"
+*   template <>
+*   constexpr auto fields_of<Book> = std::array{
+*       FIELD(Book, name), FIELD(Book, year), FIELD(Book, n_pages), FIELD(Book, hardcover) };
+*   static_assert(within_budget<Book>(268, 3), "Book grew.");
+*
+* The build then fails when the struct gets bigger or gains padding, and
+* print_layout<Book>("Book") shows every member and every padding hole.
+*
+* Only public members can be listed (offsetof needs access), and offsetof is
+* only guaranteed for 'standard layout' types. fields_of is specialized at
+* namespace scope, so the struct cannot be local to a function.
+*/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+
+struct FieldInfo {
+    const char* name;
+    size_t offset;
+    size_t size;
+    size_t align;
+};
+
+#define FIELD(Type, member) \
+    FieldInfo{ #member, offsetof(Type, member), sizeof(Type::member), alignof(decltype(Type::member)) }
+
+// Specialize for every audited type.
+template <typename T>
+constexpr std::array<FieldInfo, 0> fields_of{};
+
+template <typename T>
+constexpr size_t padding_of() {
+    size_t used{};
+    for (const auto& field : fields_of<T>) used += field.size;
+    return sizeof(T) - used;
+}
+
+// Size the struct would have with members sorted by alignment, largest first.
+template <typename T>
+constexpr size_t packed_size_of() {
+    auto fields = fields_of<T>;
+    for (size_t i{}; i < fields.size(); i++)  // insertion sort, fine for a handful
+        for (size_t j{ i }; j > 0 && fields[j - 1].align < fields[j].align; j--) {
+            const auto tmp = fields[j];
+            fields[j] = fields[j - 1];
+            fields[j - 1] = tmp;
+        }
+    size_t size{};
+    for (const auto& field : fields) size = (size + field.align - 1) / field.align * field.align + field.size;
+    return (size + alignof(T) - 1) / alignof(T) * alignof(T);
+}
+
+// Use in a static_assert next to the struct: the build fails when it grows.
+template <typename T>
+constexpr bool within_budget(size_t max_size, size_t max_padding) {
+    static_assert(std::is_standard_layout_v<T>, "offsetof needs a standard layout type.");
+    static_assert(fields_of<T>.size() > 0, "List the members with fields_of first.");
+    return sizeof(T) <= max_size && padding_of<T>() <= max_padding;
+}
+
+template <typename T>
+void print_layout(const char* name) {
+    static_assert(std::is_standard_layout_v<T>, "offsetof needs a standard layout type.");
+    printf("%s: size %zu, align %zu, padding %zu", name, sizeof(T), alignof(T), padding_of<T>());
+    if (packed_size_of<T>() < sizeof(T)) printf(", reordered: %zu", packed_size_of<T>());
+    printf("\n");
+    size_t end{};
+    for (const auto& field : fields_of<T>) {
+        if (field.offset > end) printf("  %4zu  [%zu byte hole]\n", end, field.offset - end);
+        printf("  %4zu  %-20s size %zu, align %zu\n", field.offset, field.name, field.size, field.align);
+        end = field.offset + field.size;
+    }
+    if (sizeof(T) > end) printf("  %4zu  [%zu byte tail padding]\n", end, sizeof(T) - end);
+}
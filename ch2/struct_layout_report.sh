@@ -0,0 +1,36 @@
+#!/bin/sh
+# Size and alignment of every struct and class defined in the examples, as g++
+# lays them out (x86-64 Linux). The per-member view of the audited structs comes
+# from struct_layout.cpp, which includes their real definitions. Regenerate the report from this directory with:
+#   ./struct_layout_report.sh > struct_layout_report.txt
+#
+# g++ -fdump-lang-class writes the layout of every class it sees, also the ones
+# from system headers; only classes whose name is declared with `struct` or
+# `class` in the file itself are kept. Files that do not compile on purpose
+# (they show a compiler error) are still dumped up to the error.
+set -e
+cd "$(dirname "$0")/.."
+dump=$(mktemp)
+trap 'rm -f "$dump"' EXIT
+
+echo "=== Per member (g++ -std=c++20 struct_layout.cpp && ./a.out) ==="
+g++ -std=c++20 ch2/struct_layout.cpp -o "$dump.bin" && "$dump.bin"
+rm -f "$dump.bin"
+
+echo
+echo "=== Every struct and class (g++ -fdump-lang-class) ==="
+for file in ch*/*.cpp; do
+    [ "$file" = ch2/struct_layout.cpp ] && continue
+    g++ -std=c++20 -fsyntax-only -fdump-lang-class="$dump" "$file" 2>/dev/null || true
+    [ -s "$dump" ] || continue
+    names=$(grep -oE '(struct|class) [A-Za-z_][A-Za-z0-9_]* *(final *)?(:[^:]|\{|$)' "$file" | awk '{ print $2 }' | sort -u | tr '\n' ' ')
+    awk -v file="$file" -v names=" $names" '
+        /^Class / { name = substr($0, 7) }
+        /^   size=/ {
+            base = name
+            sub(/^.*::/, "", base)   # main()::Earth -> Earth
+            sub(/<.*$/, "", base)    # SimpleVector<Point> -> SimpleVector
+            if (name !~ /std::|^__|lambda/ && index(names, " " base " ")) printf "%-44s %-40s %s %s\n", file, name, $1, $2
+        }' "$dump"
+    : > "$dump"
+done
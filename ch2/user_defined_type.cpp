@@ -3,6 +3,8 @@
 */
 #include <cstdio>
 
+#include "struct_layout.h"
+
 enum class Race {
     Elf,
     Human,
@@ -19,6 +21,11 @@ struct Book {
     int n_pages;
     bool hardcover;
 };
+// Layout budget, see struct_layout.h.
+template <>
+constexpr auto fields_of<Book> = std::array{
+    FIELD(Book, name), FIELD(Book, year), FIELD(Book, n_pages), FIELD(Book, hardcover) };
+static_assert(within_budget<Book>(268, 3), "Book grew.");
 
 int main() {
     Race enemy = Race::Human;
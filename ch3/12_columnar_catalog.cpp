@@ -0,0 +1,224 @@
+/*
+* College (array_and_pointer.cpp) and Book (ch2/user_defined_type.cpp) keep
+* their name in `char name[256]`. A Book is 268 bytes even if its name is
+* "Dune", and an array of Books is mostly unused name bytes. A loop that only
+* looks at `year` still loads whole cache lines of the records, so for every 4
+* bytes it needs it drags about 64 bytes through the cache.
+*
+* A 'columnar' (structure of arrays) store turns this around:
+* - one array per numeric field: all years next to each other, all page counts
+*   next to each other. A filter on year reads only the year column.
+* - all names packed one after the other into one 'string arena' (a single
+*   std::vector<char>), each name ended by '\0'. A row only keeps the offset of
+*   its name in the arena: 4 bytes instead of 256.
+*
+* Rows are still available as a small 'view' object holding `const char* name`
+* (pointing into the arena) plus the numbers. print_college_better only needs
+* `rows[i].name`, so as a template it accepts a College* and the columnar
+* catalog alike.
+*
+* compile: `g++ -std=c++20 -O2 12_columnar_catalog.cpp -o columnar_catalog`
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+// Same as array_and_pointer.cpp.
+struct College
+{
+    char name[256];
+};
+
+// Same as ch2/user_defined_type.cpp.
+struct Book {
+    char name[256];
+    int year;
+    int n_pages;
+    bool hardcover;
+};
+
+// Same loop as array_and_pointer.cpp; `rows` may be a College array or the rows()
+// of a catalog, anything where rows[i].name is a C string. Taken by reference:
+// a catalog must not be copied just to be printed.
+template <typename Rows>
+void print_college_better(const Rows& rows, size_t n_colleges) {
+    for (size_t i = 0; i < n_colleges; i++) {
+        printf("%s College\n", rows[i].name);
+    }
+}
+
+// All names back to back, each ended by '\0' so they can go straight to printf.
+class StringArena {
+public:
+    uint32_t add(std::string_view name) {
+        if (chars.size() + name.size() + 1 > UINT32_MAX) throw std::length_error{ "Arena is full." };
+        const auto offset = static_cast<uint32_t>(chars.size());
+        chars.insert(chars.end(), name.begin(), name.end());
+        chars.push_back('\0');
+        return offset;
+    }
+    const char* get(uint32_t offset) const { return chars.data() + offset; }
+    size_t memory_bytes() const { return chars.capacity(); }
+private:
+    std::vector<char> chars;
+};
+
+struct CollegeRow {
+    const char* name;
+};
+
+class CollegeCatalog {
+public:
+    void add(std::string_view name) { name_offset.push_back(names.add(name)); }
+    CollegeRow operator[](size_t i) const { return { names.get(name_offset[i]) }; }
+    const CollegeCatalog& rows() const { return *this; }
+    size_t size() const { return name_offset.size(); }
+private:
+    StringArena names;
+    std::vector<uint32_t> name_offset;
+};
+
+// Same fields as Book, but a copy of the values, not a reference to a struct.
+struct BookRow {
+    const char* name;
+    int year;
+    int n_pages;
+    bool hardcover;
+};
+
+class BookCatalog {
+public:
+    void add(std::string_view name, int year, int n_pages, bool hardcover) {
+        name_offset.push_back(names.add(name));
+        years.push_back(year);
+        pages.push_back(n_pages);
+        hardcovers.push_back(hardcover);
+    }
+    BookRow operator[](size_t i) const {
+        return { names.get(name_offset[i]), years[i], pages[i], hardcovers[i] != 0 };
+    }
+    const BookCatalog& rows() const { return *this; }
+    size_t size() const { return years.size(); }
+
+    // The columns, for loops that only need one or two fields.
+    const std::vector<int>& year() const { return years; }
+    const std::vector<int>& n_pages() const { return pages; }
+
+    size_t memory_bytes() const {
+        return names.memory_bytes() + name_offset.capacity() * sizeof(uint32_t) + years.capacity() * sizeof(int) +
+               pages.capacity() * sizeof(int) + hardcovers.capacity();
+    }
+
+    void reserve(size_t n) {
+        name_offset.reserve(n);
+        years.reserve(n);
+        pages.reserve(n);
+        hardcovers.reserve(n);
+    }
+
+private:
+    StringArena names;
+    std::vector<uint32_t> name_offset;
+    std::vector<int> years;
+    std::vector<int> pages;
+    std::vector<uint8_t> hardcovers;  // not std::vector<bool>, which packs bits
+};
+
+// The filter of the benchmark: long books of the nineties.
+bool is_match(int year, int n_pages) { return year >= 1990 && year < 2000 && n_pages > 300; }
+
+size_t count_matches(const Book* books, size_t n) {
+    size_t count{};
+    for (size_t i{}; i < n; i++) if (is_match(books[i].year, books[i].n_pages)) count++;
+    return count;
+}
+
+size_t count_matches(const BookCatalog& catalog) {
+    const int* year = catalog.year().data();
+    const int* pages = catalog.n_pages().data();
+    size_t count{};
+    for (size_t i{}; i < catalog.size(); i++) if (is_match(year[i], pages[i])) count++;
+    return count;
+}
+
+// Same filter, then use the name of every match.
+size_t name_bytes_of_matches(const Book* books, size_t n) {
+    size_t total{};
+    for (size_t i{}; i < n; i++) {
+        if (is_match(books[i].year, books[i].n_pages)) total += strlen(books[i].name);
+    }
+    return total;
+}
+
+size_t name_bytes_of_matches(const BookCatalog& catalog) {
+    const int* year = catalog.year().data();
+    const int* pages = catalog.n_pages().data();
+    size_t total{};
+    for (size_t i{}; i < catalog.size(); i++) {
+        if (is_match(year[i], pages[i])) total += strlen(catalog[i].name);
+    }
+    return total;
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    College best_colleges[] { "tokhchi", "goozabad", "nabood_dge"};
+    print_college_better(best_colleges, sizeof(best_colleges) / sizeof(College));
+
+    CollegeCatalog colleges;
+    for (const char* name : { "tokhchi", "goozabad", "nabood_dge" }) colleges.add(name);
+    print_college_better(colleges.rows(), colleges.size());
+    printf("%zu bytes as College[3], about %zu as a catalog\n\n",
+           sizeof(best_colleges), 3 * sizeof(uint32_t) + sizeof("tokhchi") + sizeof("goozabad") + sizeof("nabood_dge"));
+
+    // 2M books with names of 8 to 40 characters.
+    const size_t n{ 2'000'000 };
+    std::vector<Book> books(n);
+    BookCatalog catalog;
+    catalog.reserve(n);
+    char name[64];
+    for (size_t i{}; i < n; i++) {
+        const int length = snprintf(name, sizeof(name), "Book %zu%.*s", i, static_cast<int>(i % 30), "-of-the-galactic-empire-volume");
+        const int year = 1900 + static_cast<int>(i * 7919 % 124);
+        const int n_pages = 50 + static_cast<int>(i * 104729 % 900);
+        std::memcpy(books[i].name, name, static_cast<size_t>(length) + 1);
+        books[i].year = year;
+        books[i].n_pages = n_pages;
+        books[i].hardcover = i % 3 == 0;
+        catalog.add({ name, static_cast<size_t>(length) }, year, n_pages, i % 3 == 0);
+    }
+
+    printf("%zu books\n", n);
+    printf("Book array: %8.1f MB\n", n * sizeof(Book) / 1e6);
+    printf("catalog:    %8.1f MB\n", catalog.memory_bytes() / 1e6);
+
+    size_t c1{}, c2{}, b1{}, b2{};
+    const double t_count_rows = milliseconds([&] { c1 = count_matches(books.data(), n); });
+    const double t_count_columns = milliseconds([&] { c2 = count_matches(catalog); });
+    const double t_names_rows = milliseconds([&] { b1 = name_bytes_of_matches(books.data(), n); });
+    const double t_names_columns = milliseconds([&] { b2 = name_bytes_of_matches(catalog); });
+    printf("\nfilter 1990 <= year < 2000 && n_pages > 300\n");
+    printf("count:            Book array %7.2f ms, catalog %7.2f ms  (%zu, %zu)  %.1fx\n",
+           t_count_rows, t_count_columns, c1, c2, t_count_rows / t_count_columns);
+    printf("count + names:    Book array %7.2f ms, catalog %7.2f ms  (%zu, %zu)  %.1fx\n",
+           t_names_rows, t_names_columns, b1, b2, t_names_rows / t_names_columns);
+    return 0;
+}
+
+/* TAKEAWAY
+* The filter reads 8 bytes per book from the catalog and a full cache line per
+* book from the Book array, and the times follow the bytes. Names are only
+* touched for the few matches. The catch: a row is now spread over five arrays,
+* so code that always needs the whole record gains little.
+*/
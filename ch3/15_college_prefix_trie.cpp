@@ -0,0 +1,206 @@
+/*
+* "All colleges starting with 'go'" with print_college_better's loop is a
+* strncmp against every College: O(n) per query, however few colleges match.
+*
+* Two steps make it O(length of the prefix + number of results):
+*
+* 1. Sort the ids of the colleges by name. All names with the same prefix are
+*    then next to each other: the answer to every prefix query is one
+*    contiguous range [first, last) of the sorted ids.
+* 2. Build a 'radix trie' (a path compressed trie) over the sorted names. Each
+*    node stands for one prefix and stores the range of sorted ids below it.
+*    Its edge label is a run of characters that all names below it share, so
+*    chains of single-child nodes collapse into one node, and there are fewer
+*    nodes than names. The label is not copied, the node points into the name
+*    of one of its colleges instead.
+*
+* A query walks down the trie comparing the prefix with the labels, which costs
+* O(prefix length), and returns the id range of the node where the prefix
+* ends: no scanning, no copying.
+*
+* Nodes live in one array and the children of a node are next to each other
+* in that array ('array-packed'), so a node only needs the index of its first
+* child and the number of children.
+*
+* compile: `g++ -std=c++20 -O2 15_college_prefix_trie.cpp -o prefix_trie`
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Same as array_and_pointer.cpp.
+struct College
+{
+    char name[256];
+};
+
+class CollegePrefixIndex {
+public:
+    explicit CollegePrefixIndex(std::span<const College> colleges) : colleges{ colleges }, ids(colleges.size()) {
+        for (size_t i{}; i < ids.size(); i++) ids[i] = static_cast<uint32_t>(i);
+        std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+            return std::strcmp(colleges[a].name, colleges[b].name) < 0;
+        });
+        nodes.push_back({});
+        if (!ids.empty()) build(0, 0, static_cast<uint32_t>(ids.size()), 0);
+    }
+
+    // Ids of all colleges whose name starts with `prefix`, sorted by name.
+    std::span<const uint32_t> starting_with(std::string_view prefix) const {
+        if (ids.empty()) return {};
+        const Node* node = &nodes[0];
+        size_t matched{};
+        for (;;) {
+            // Compare the label of this node with the rest of the prefix.
+            const char* label = name(node->first) + node->depth;
+            const size_t n = std::min<size_t>(node->label_length, prefix.size() - matched);
+            if (std::memcmp(label, prefix.data() + matched, n) != 0) return {};
+            matched += n;
+            if (matched == prefix.size()) return { ids.data() + node->first, ids.data() + node->last };
+            // Go to the child whose label starts with the next character.
+            const Node* child = find_child(*node, prefix[matched]);
+            if (!child) return {};
+            node = child;
+        }
+    }
+
+    size_t node_count() const { return nodes.size(); }
+    size_t memory_bytes() const { return nodes.capacity() * sizeof(Node) + ids.capacity() * sizeof(uint32_t); }
+
+private:
+    struct Node {
+        uint32_t first, last;     // range in `ids` of the names below this node
+        uint32_t first_child;     // children are nodes[first_child .. first_child + n_children)
+        uint16_t depth;           // label starts at name(first) + depth ...
+        uint16_t label_length;    // ... and is this long
+        uint16_t n_children;
+    };
+
+    const char* name(uint32_t sorted_position) const { return colleges[ids[sorted_position]].name; }
+
+    const Node* find_child(const Node& node, char c) const {
+        for (uint32_t i{}; i < node.n_children; i++) {
+            const Node& child = nodes[node.first_child + i];
+            if (name(child.first)[child.depth] == c) return &child;
+        }
+        return nullptr;
+    }
+
+    // Fills nodes[index] for the names [first, last), which share `depth` characters.
+    void build(uint32_t index, uint32_t first, uint32_t last, uint16_t depth) {
+        // The first and the last name (sorted) share the prefix all of them share.
+        const char* a = name(first);
+        const char* b = name(last - 1);
+        uint16_t end{ depth };
+        while (a[end] && a[end] == b[end]) end++;
+        nodes[index] = { first, last, 0, depth, static_cast<uint16_t>(end - depth), 0 };
+
+        // Names that end right here come first; the rest are grouped by their
+        // next character, one child per group.
+        uint32_t group = first;
+        while (group < last && name(group)[end] == '\0') group++;
+        std::vector<std::pair<uint32_t, uint32_t>> groups;
+        while (group < last) {
+            const char c = name(group)[end];
+            uint32_t group_end = group + 1;
+            while (group_end < last && name(group_end)[end] == c) group_end++;
+            groups.emplace_back(group, group_end);
+            group = group_end;
+        }
+        const auto first_child = static_cast<uint32_t>(nodes.size());
+        nodes[index].first_child = first_child;
+        nodes[index].n_children = static_cast<uint16_t>(groups.size());
+        nodes.resize(nodes.size() + groups.size());  // reserve the children next to each other
+        for (size_t i{}; i < groups.size(); i++) {
+            build(first_child + static_cast<uint32_t>(i), groups[i].first, groups[i].second, end);
+        }
+    }
+
+    std::span<const College> colleges;
+    std::vector<uint32_t> ids;  // college ids, sorted by name
+    std::vector<Node> nodes;
+};
+
+// The old way: a strncmp against every name.
+std::vector<uint32_t> starting_with_linear(std::span<const College> colleges, std::string_view prefix) {
+    std::vector<uint32_t> found;
+    for (size_t i = 0; i < colleges.size(); i++) {
+        if (std::strncmp(colleges[i].name, prefix.data(), prefix.size()) == 0) found.push_back(static_cast<uint32_t>(i));
+    }
+    return found;
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const College best_colleges[] { "tokhchi", "goozabad", "nabood_dge", "golestan", "gonbad", "goozabad_north" };
+    const CollegePrefixIndex small{ best_colleges };
+    for (const char* prefix : { "go", "goo", "t", "x", "" }) {
+        printf("'%s':", prefix);
+        for (uint32_t id : small.starting_with(prefix)) printf(" %s", best_colleges[id].name);
+        printf("\n");
+    }
+
+    // 1M names made of syllables, like "tokhbadgoo_17".
+    const char* syllables[]{ "to", "kh", "chi", "goo", "za", "bad", "na", "bood", "dge", "les", "tan", "gon",
+                             "shi", "raz", "ta", "briz", "ma", "shad", "is", "fa", "han", "ker", "man", "yazd" };
+    const size_t n{ 1'000'000 };
+    std::vector<College> colleges(n);
+    std::mt19937 random{ 42 };
+    for (auto& college : colleges) {
+        std::string name;
+        for (unsigned s = 0, length = 2 + random() % 3; s < length; s++) name += syllables[random() % std::size(syllables)];
+        name += "_" + std::to_string(random() % 100);
+        std::strncpy(college.name, name.c_str(), sizeof(college.name) - 1);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const CollegePrefixIndex index{ colleges };
+    const double t_build = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Prefixes of existing names, 2 to 8 characters long.
+    std::vector<std::string> prefixes(10'000);
+    for (auto& prefix : prefixes) {
+        const College& college = colleges[random() % n];
+        prefix.assign(college.name, std::min(std::strlen(college.name), size_t{ 2 } + random() % 7));
+    }
+
+    size_t trie_results{}, linear_results{};
+    const double t_trie = milliseconds([&] {
+        for (const auto& prefix : prefixes) trie_results += index.starting_with(prefix).size();
+    });
+    const size_t n_linear{ 50 };
+    const double t_linear = milliseconds([&] {
+        for (size_t i{}; i < n_linear; i++) linear_results += starting_with_linear(colleges, prefixes[i]).size();
+    });
+    size_t check{};
+    for (size_t i{}; i < n_linear; i++) check += index.starting_with(prefixes[i]).size();
+
+    printf("\n=== %zu college names ===\n", n);
+    printf("build (sort + trie): %8.1f ms, %zu nodes, %.1f bytes per name (plus the names)\n",
+           t_build, index.node_count(), static_cast<double>(index.memory_bytes()) / n);
+    printf("trie query:          %8.3f us  (%.1f results on average)\n",
+           t_trie * 1e3 / prefixes.size(), static_cast<double>(trie_results) / prefixes.size());
+    printf("linear scan:         %8.3f us  %s\n", t_linear * 1e3 / n_linear, linear_results == check ? "" : "MISMATCH");
+    return 0;
+}
+
+/* TAKEAWAY
+* The query cost no longer depends on the number of colleges, only on the
+* length of the prefix; the results are a span into the sorted ids, so a prefix
+* matching 100k names costs the same as one matching 3. The trie needs fewer
+* nodes than names, and it never copies a name.
+*/
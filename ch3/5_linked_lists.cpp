@@ -4,6 +4,8 @@
 */
 #include <cstdio>
 
+#include "../ch2/struct_layout.h"
+
 /*
 * Singly linked list: inserting in linked lists is very efficient. last element
 * points to nullptr to indicate end of linked list. memory allocation is 
@@ -19,6 +21,11 @@ struct Element
     char prefix[2];
     short operating_number;
 };
+// Layout budget, see ch2/struct_layout.h.
+template <>
+constexpr auto fields_of<Element> = std::array{
+    FIELD(Element, next), FIELD(Element, prefix), FIELD(Element, operating_number) };
+static_assert(within_budget<Element>(16, 4), "Element grew.");
 
 int main() {
     Element trooper1, trooper2, trooper3;
@@ -0,0 +1,263 @@
+/*
+* The Element list of 5_linked_lists.cpp stores 4 bytes of payload (prefix[2]
+* + operating_number) next to an 8 byte `next` pointer, 16 bytes with padding.
+* Worse, walking it is 'pointer chasing': the address of the next element is
+* only known once the current one is loaded, so when the elements are spread
+* over memory every step is a cache miss, and the CPU cannot prefetch ahead.
+*
+* An 'unrolled linked list' keeps the linked list idea, but every node holds a
+* small array of records: 29 troopers in a 128 byte node (two cache lines).
+* Inside the node the fields are stored 'structure of arrays' (SoA): all
+* operating numbers next to each other, then all prefixes. Walking the list is
+* now one pointer chase per 29 records, and scanning operating numbers reads
+* consecutive shorts.
+*
+* insert_next stays O(1): a record is inserted after a cursor by shifting at
+* most 28 records inside its node; a full node is split in two first.
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Same as 5_linked_lists.cpp.
+struct Element
+{
+    Element* next{};  // initialized with nullptr
+    void insert_next(Element* new_element) {
+        new_element->next = next;
+        next = new_element;
+    }
+    char prefix[2];
+    short operating_number;
+};
+
+struct Trooper {
+    char prefix[2];
+    short operating_number;
+};
+
+constexpr size_t node_bytes{ 128 };
+constexpr size_t node_capacity{ (node_bytes - sizeof(void*) - sizeof(uint16_t)) / (2 + sizeof(short)) };
+
+struct alignas(64) TrooperNode {
+    TrooperNode* next{};
+    uint16_t count{};
+    short operating_number[node_capacity];
+    char prefix[node_capacity][2];
+};
+static_assert(sizeof(TrooperNode) == node_bytes);
+
+// Position of one record: which node, which slot.
+struct TrooperCursor {
+    TrooperNode* node;
+    size_t index;
+
+    Trooper get() const {
+        return { { node->prefix[index][0], node->prefix[index][1] }, node->operating_number[index] };
+    }
+    bool valid() const { return node != nullptr; }
+    void advance() {
+        if (++index == node->count) {
+            node = node->next;
+            index = 0;
+        }
+    }
+};
+
+class UnrolledTrooperList {
+public:
+    UnrolledTrooperList() = default;
+    ~UnrolledTrooperList() {
+        for (TrooperNode* slab : slabs) delete[] slab;
+    }
+    UnrolledTrooperList(const UnrolledTrooperList&) = delete;
+    UnrolledTrooperList& operator=(const UnrolledTrooperList&) = delete;
+
+    TrooperCursor begin() const { return { head && head->count ? head : nullptr, 0 }; }
+
+    // Append at the end; returns the cursor of the new record.
+    TrooperCursor push_back(const Trooper& trooper) {
+        if (!tail) {
+            head = tail = allocate_node();
+        } else if (tail->count == node_capacity) {
+            tail->next = allocate_node();
+            tail = tail->next;
+        }
+        const size_t index = tail->count++;
+        store(tail, index, trooper);
+        return { tail, index };
+    }
+
+    // Same meaning as Element::insert_next: the new record comes right after
+    // `position`. O(1): at most one split plus a shift inside one node.
+    // Like iterators of std::vector, cursors behind `position` in the same
+    // node are invalidated (their record moved one slot or to the new node).
+    TrooperCursor insert_next(TrooperCursor position, const Trooper& trooper) {
+        TrooperNode* node = position.node;
+        size_t index = position.index + 1;
+        if (node->count == node_capacity) {
+            // Split: the upper half moves to a new node right after this one.
+            auto* upper = allocate_node();
+            const size_t keep = node_capacity / 2;
+            upper->count = static_cast<uint16_t>(node_capacity - keep);
+            std::memcpy(upper->operating_number, node->operating_number + keep, upper->count * sizeof(short));
+            std::memcpy(upper->prefix, node->prefix + keep, upper->count * sizeof(node->prefix[0]));
+            node->count = static_cast<uint16_t>(keep);
+            upper->next = node->next;
+            node->next = upper;
+            if (tail == node) tail = upper;
+            if (index > keep) {
+                node = upper;
+                index -= keep;
+            }
+        }
+        const size_t moved = node->count - index;
+        std::memmove(node->operating_number + index + 1, node->operating_number + index, moved * sizeof(short));
+        std::memmove(node->prefix + index + 1, node->prefix + index, moved * sizeof(node->prefix[0]));
+        node->count++;
+        store(node, index, trooper);
+        return { node, index };
+    }
+
+    // Walks the nodes and the operating_number array of each: the hot loop.
+    long sum_operating_numbers() const {
+        long total{};
+        for (const TrooperNode* node = head; node; node = node->next) {
+            __builtin_prefetch(node->next);  // start loading the next node while we sum this one
+            for (size_t i{}; i < node->count; i++) total += node->operating_number[i];
+        }
+        return total;
+    }
+
+private:
+    // Nodes come from slabs of 512, so nodes allocated one after the other are
+    // also next to each other in memory. They are only freed with the list.
+    TrooperNode* allocate_node() {
+        if (slabs.empty() || slab_used == slab_nodes) {
+            slabs.push_back(new TrooperNode[slab_nodes]);
+            slab_used = 0;
+        }
+        return &slabs.back()[slab_used++];
+    }
+
+    static void store(TrooperNode* node, size_t index, const Trooper& trooper) {
+        node->prefix[index][0] = trooper.prefix[0];
+        node->prefix[index][1] = trooper.prefix[1];
+        node->operating_number[index] = trooper.operating_number;
+    }
+
+    static constexpr size_t slab_nodes{ 512 };
+    std::vector<TrooperNode*> slabs;
+    size_t slab_used{};
+    TrooperNode* head{};
+    TrooperNode* tail{};
+};
+
+long sum_operating_numbers(const Element* first) {
+    long total{};
+    for (const Element* cursor = first; cursor; cursor = cursor->next) total += cursor->operating_number;
+    return total;
+}
+
+// Allocations of random size between the ones we care about, so that the
+// list ends up spread over the heap like in a long running program.
+struct Scatter {
+    std::vector<char*> junk;
+    std::mt19937 random{ 42 };
+    void allocate() { junk.push_back(new char[16 + random() % 512]); }
+    ~Scatter() { for (char* p : junk) delete[] p; }
+};
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    UnrolledTrooperList troopers;
+    auto first = troopers.push_back({ { 'A', 'B' }, 101 });
+    troopers.insert_next(first, { { 'X', 'Y' }, 103 });
+    troopers.insert_next(first, { { 'M', 'N' }, 102 });
+    for (auto cursor = troopers.begin(); cursor.valid(); cursor.advance()) {
+        const Trooper trooper = cursor.get();
+        printf("Trooper %c%c, Nr:%d\n", trooper.prefix[0], trooper.prefix[1], trooper.operating_number);
+    }
+
+    const size_t n{ 4'000'000 };
+    printf("\n%zu troopers, Element is %zu bytes, TrooperNode is %zu bytes for %zu troopers\n",
+           n, sizeof(Element), sizeof(TrooperNode), node_capacity);
+
+    // Intrusive list, elements allocated one after the other.
+    std::vector<Element> sequential(n);
+    for (size_t i{}; i + 1 < n; i++) sequential[i].next = &sequential[i + 1];
+    for (size_t i{}; i < n; i++) sequential[i].operating_number = static_cast<short>(i % 1000);
+
+    // Intrusive list, elements spread over the heap.
+    std::vector<Element*> scattered(n);
+    {
+        Scatter scatter;
+        for (size_t i{}; i < n; i++) {
+            scatter.allocate();
+            scattered[i] = new Element{};
+            scattered[i]->operating_number = static_cast<short>(i % 1000);
+        }
+        for (size_t i{}; i + 1 < n; i++) scattered[i]->next = scattered[i + 1];
+    }
+
+    // Unrolled list, appended: nodes in memory order.
+    UnrolledTrooperList unrolled;
+    for (size_t i{}; i < n; i++) unrolled.push_back({ { 'T', 'K' }, static_cast<short>(i % 1000) });
+
+    // Unrolled list built with insert_next after the head: every split puts a
+    // new node from the end of the pool right behind the first node, so the
+    // list order runs backwards through memory.
+    UnrolledTrooperList inserted;
+    const auto front = inserted.push_back({ { 'H', 'D' }, 0 });
+
+    // Insertion right after the head, n times.
+    std::vector<Element> storage(n);
+    Element head{};
+    const double t_insert_element = milliseconds([&] {
+        for (size_t i{}; i < n; i++) {
+            storage[i].operating_number = static_cast<short>(i % 1000);
+            head.insert_next(&storage[i]);
+        }
+    });
+    const double t_insert_unrolled = milliseconds([&] {
+        for (size_t i{}; i < n; i++) inserted.insert_next(front, { { 'T', 'K' }, static_cast<short>(i % 1000) });
+    });
+    printf("\n=== insert_next after the head ===\n");
+    printf("Element:  %8.2f ms (storage preallocated)\n", t_insert_element);
+    printf("unrolled: %8.2f ms (including node allocation)\n", t_insert_unrolled);
+
+    long r1{}, r2{}, r3{}, r4{}, r5{};
+    const double t1 = milliseconds([&] { r1 = sum_operating_numbers(&sequential[0]); });
+    const double t2 = milliseconds([&] { r2 = sum_operating_numbers(scattered[0]); });
+    const double t3 = milliseconds([&] { r3 = sum_operating_numbers(head.next); });
+    const double t4 = milliseconds([&] { r4 = unrolled.sum_operating_numbers(); });
+    const double t5 = milliseconds([&] { r5 = inserted.sum_operating_numbers(); });
+    printf("\n=== traversal ===\n");
+    printf("Element, sequential:          %8.2f ms  (%ld)\n", t1, r1);
+    printf("Element, scattered:           %8.2f ms  (%ld)\n", t2, r2);
+    printf("Element, inserted at head:    %8.2f ms  (%ld)\n", t3, r3);
+    printf("unrolled, appended:           %8.2f ms  (%ld)\n", t4, r4);
+    printf("unrolled, inserted at head:   %8.2f ms  (%ld)\n", t5, r5);
+
+    for (Element* element : scattered) delete element;
+    return 0;
+}
+
+/* TAKEAWAY
+* Same asymptotic cost, very different constant: the unrolled list touches
+* about 4.4 bytes per trooper instead of 16 and pays one pointer chase per node
+* instead of one per trooper. The price is insertion: the intrusive list
+* writes two pointers, the unrolled list shifts up to 28 records and sometimes
+* splits a node. That is a good trade when the list is read far more often
+* than it is modified.
+*/
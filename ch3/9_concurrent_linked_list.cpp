@@ -0,0 +1,392 @@
+/*
+* Element::insert_next from 5_linked_lists.cpp is two plain pointer writes. If
+* two threads insert after the same element at the same time, both read the
+* same old `next` and one of the new elements is lost (a 'data race', which is
+* undefined behavior in C++ anyway). The usual fix is a mutex around the list.
+*
+* This file builds a list that several threads can change without a lock:
+*
+* - Insertion uses compare-and-swap (CAS): "set next to new_element, but only
+*   if next is still what I read". If another thread was faster the CAS fails,
+*   we re-read and try again. Some thread always makes progress (non-blocking).
+* - Deletion is two steps (Harris' list). First the element is 'logically
+*   deleted' by setting the lowest bit of its own `next` pointer (elements are
+*   aligned, so that bit is always 0 in a real pointer). A marked `next` can no
+*   longer be CASed, so nobody can insert behind a deleted element. Then it is
+*   unlinked from its predecessor; if that CAS fails, the next thread walking
+*   past the element unlinks it ('helping').
+* - Readers only load pointers and skip marked elements. They never retry and
+*   never wait for a writer: iteration is wait-free.
+* - Memory reclamation: an unlinked element cannot be deleted right away, a
+*   reader may still be standing on it. 'Epoch based reclamation' fixes this:
+*   every operation runs inside a Guard that announces the global epoch the
+*   thread saw. Unlinked elements are 'retired' with the current epoch and only
+*   deleted once the global epoch has moved two steps further, which can only
+*   happen after every thread inside a Guard has seen the newer epochs.
+*
+* compile: `g++ -std=c++20 -O2 -pthread 9_concurrent_linked_list.cpp -o concurrent_list`
+*          (add `-fsanitize=thread` to let ThreadSanitizer check the stress test)
+*/
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Same as 5_linked_lists.cpp.
+struct Element
+{
+    Element* next{};  // initialized with nullptr
+    void insert_next(Element* new_element) {
+        new_element->next = next;
+        next = new_element;
+    }
+    char prefix[2];
+    short operating_number;
+};
+
+// Like Element, but `next` is atomic and its lowest bit is the 'deleted' mark.
+struct ConcurrentElement {
+    std::atomic<uintptr_t> next{};
+    char prefix[2];
+    short operating_number;
+};
+
+constexpr uintptr_t deleted_bit{ 1 };
+inline ConcurrentElement* pointer(uintptr_t link) {
+    return reinterpret_cast<ConcurrentElement*>(link & ~deleted_bit);
+}
+inline bool is_deleted(uintptr_t link) { return link & deleted_bit; }
+inline uintptr_t link(ConcurrentElement* element) { return reinterpret_cast<uintptr_t>(element); }
+
+// Epoch based reclamation for ConcurrentElement. One global instance, every
+// thread gets its own slot on first use and gives it back when it exits.
+class Epochs {
+    static constexpr uint64_t idle{ ~uint64_t{} };
+
+    struct Bucket {
+        uint64_t epoch{};
+        std::vector<ConcurrentElement*> elements;
+    };
+    // One cache line per slot, see PaddedSum in ch6/9.
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{ idle };
+        std::atomic<bool> in_use{};
+        unsigned depth{};  // Guards may nest, only the outermost one announces
+        Bucket retired[3];
+    };
+
+public:
+    static constexpr size_t max_threads{ 128 };
+
+    // Announces "this thread may be reading the list" for its lifetime.
+    struct Guard {
+        explicit Guard(Epochs& epochs) : slot(epochs.own_slot()) {
+            if (slot.depth++ == 0) slot.epoch.store(epochs.global.load(), std::memory_order_seq_cst);
+        }
+        ~Guard() {
+            if (--slot.depth == 0) slot.epoch.store(idle, std::memory_order_release);
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        Slot& slot;
+    };
+
+    ~Epochs() {
+        for (auto& slot : slots)
+            for (auto& bucket : slot.retired)
+                for (auto* element : bucket.elements) delete element;
+    }
+
+    // Call after unlinking `element`, from inside a Guard.
+    void retire(ConcurrentElement* element) {
+        Slot& slot = own_slot();
+        const uint64_t now = global.load();
+        auto& bucket = slot.retired[now % 3];
+        if (bucket.epoch != now) {
+            // The bucket holds epoch now - 3 or older: nobody can see those anymore.
+            for (auto* old : bucket.elements) delete old;
+            bucket.elements.clear();
+            bucket.epoch = now;
+        }
+        bucket.elements.push_back(element);
+        if (bucket.elements.size() % 64 == 0) try_advance(now);
+    }
+
+private:
+    // The epoch may move on once every thread inside a Guard has seen it.
+    void try_advance(uint64_t now) {
+        for (const auto& slot : slots) {
+            const uint64_t seen = slot.epoch.load(std::memory_order_seq_cst);
+            if (seen != idle && seen != now) return;
+        }
+        global.compare_exchange_strong(now, now + 1);
+    }
+
+    Slot& own_slot() {
+        struct Owner {
+            Slot* slot{};
+            ~Owner() { if (slot) slot->in_use.store(false); }
+        };
+        thread_local Owner owner;
+        if (!owner.slot) {
+            for (auto& slot : slots) {
+                if (!slot.in_use.exchange(true)) {
+                    owner.slot = &slot;
+                    break;
+                }
+            }
+            if (!owner.slot) throw std::runtime_error{ "Too many threads." };
+        }
+        return *owner.slot;
+    }
+
+    std::atomic<uint64_t> global{};
+    Slot slots[max_threads];
+};
+
+Epochs epochs;
+
+class ConcurrentTrooperList {
+public:
+    ConcurrentTrooperList() = default;
+    ~ConcurrentTrooperList() {
+        // No other thread may use the list anymore. Marked but not yet unlinked
+        // elements are still in the chain and were never retired.
+        ConcurrentElement* cursor = pointer(head.next.load());
+        while (cursor) {
+            ConcurrentElement* next = pointer(cursor->next.load());
+            delete cursor;
+            cursor = next;
+        }
+    }
+    ConcurrentTrooperList(const ConcurrentTrooperList&) = delete;
+    ConcurrentTrooperList& operator=(const ConcurrentTrooperList&) = delete;
+
+    // Insert at the front. Retries until the CAS on the head wins.
+    ConcurrentElement* push_front(char prefix0, char prefix1, short operating_number) {
+        auto* element = new ConcurrentElement{ {}, { prefix0, prefix1 }, operating_number };
+        while (!try_insert_next(&head, element)) {}
+        return element;
+    }
+
+    // Same meaning as Element::insert_next. Fails (returns false) if `position`
+    // was deleted meanwhile; the caller must hold a Guard since reading `position`.
+    bool insert_next(ConcurrentElement* position, ConcurrentElement* new_element) {
+        for (;;) {
+            if (try_insert_next(position, new_element)) return true;
+            if (is_deleted(position->next.load())) return false;
+        }
+    }
+
+    // Logically deletes the first trooper with this name, then tries to unlink it.
+    bool remove(char prefix0, char prefix1, short operating_number) {
+        Epochs::Guard guard{ epochs };
+        for (;;) {
+            auto [previous, current] = find(prefix0, prefix1, operating_number);
+            if (!current) return false;
+            uintptr_t next = current->next.load();
+            if (is_deleted(next)) continue;  // another thread deleted it first
+            if (!current->next.compare_exchange_strong(next, next | deleted_bit)) continue;
+            uintptr_t expected = link(current);
+            if (previous->next.compare_exchange_strong(expected, next)) epochs.retire(current);
+            return true;
+        }
+    }
+
+    // Wait-free: only loads, no retries. Deleted elements are skipped.
+    template <typename F>
+    void for_each(F&& f) const {
+        Epochs::Guard guard{ epochs };
+        for (const ConcurrentElement* cursor = pointer(head.next.load(std::memory_order_acquire)); cursor;) {
+            const uintptr_t next = cursor->next.load(std::memory_order_acquire);
+            if (!is_deleted(next)) f(*cursor);
+            cursor = pointer(next);
+        }
+    }
+
+private:
+    static bool try_insert_next(ConcurrentElement* position, ConcurrentElement* new_element) {
+        uintptr_t next = position->next.load();
+        if (is_deleted(next)) return false;
+        new_element->next.store(next, std::memory_order_relaxed);
+        return position->next.compare_exchange_weak(next, link(new_element),
+                                                    std::memory_order_release, std::memory_order_relaxed);
+    }
+
+    struct Found {
+        ConcurrentElement* previous;
+        ConcurrentElement* current;
+    };
+
+    // Harris' search: unlinks every marked element it walks past.
+    Found find(char prefix0, char prefix1, short operating_number) {
+    retry:
+        ConcurrentElement* previous = &head;
+        ConcurrentElement* current = pointer(previous->next.load());
+        while (current) {
+            const uintptr_t next = current->next.load();
+            if (is_deleted(next)) {
+                uintptr_t expected = link(current);
+                if (!previous->next.compare_exchange_strong(expected, link(pointer(next)))) goto retry;
+                epochs.retire(current);
+                current = pointer(next);
+                continue;
+            }
+            if (current->operating_number == operating_number &&
+                current->prefix[0] == prefix0 && current->prefix[1] == prefix1) return { previous, current };
+            previous = current;
+            current = pointer(next);
+        }
+        return { previous, nullptr };
+    }
+
+    ConcurrentElement head{};  // sentinel, its `next` is the first element
+};
+
+// For comparison: the plain Element list behind one mutex.
+class LockedTrooperList {
+public:
+    ~LockedTrooperList() {
+        while (head.next) {
+            Element* next = head.next->next;
+            delete head.next;
+            head.next = next;
+        }
+    }
+    void push_front(char prefix0, char prefix1, short operating_number) {
+        auto* element = new Element{ nullptr, { prefix0, prefix1 }, operating_number };
+        std::lock_guard<std::mutex> lock{ mutex };
+        head.insert_next(element);
+    }
+    template <typename F>
+    void for_each(F&& f) const {
+        std::lock_guard<std::mutex> lock{ mutex };
+        for (const Element* cursor = head.next; cursor; cursor = cursor->next) f(*cursor);
+    }
+private:
+    mutable std::mutex mutex;
+    Element head{};
+};
+
+// Producers insert troopers {'A' + t, 'P'} 0..n-1, removers delete the odd
+// numbers of their producer while it is still inserting, readers keep walking
+// the list. At the end exactly the even numbers must be left, each once.
+bool stress_test(unsigned n_producers, short n_per_producer) {
+    ConcurrentTrooperList troopers;
+    std::atomic<bool> done{};
+    std::atomic<size_t> reader_visits{};
+    std::vector<std::thread> threads;
+    for (unsigned t{}; t < n_producers; t++) {
+        const char prefix = static_cast<char>('A' + t);
+        threads.emplace_back([&, prefix] {
+            for (short i{}; i < n_per_producer; i++) troopers.push_front(prefix, 'P', i);
+        });
+        threads.emplace_back([&, prefix] {
+            for (short i{ 1 }; i < n_per_producer; i += 2)
+                while (!troopers.remove(prefix, 'P', i)) std::this_thread::yield();  // not inserted yet
+        });
+    }
+    std::thread reader{ [&] {
+        while (!done) troopers.for_each([&](const ConcurrentElement&) { reader_visits++; });
+    } };
+    for (auto& thread : threads) thread.join();
+    done = true;
+    reader.join();
+
+    std::vector<int> seen(n_producers * static_cast<size_t>(n_per_producer));
+    bool ok{ true };
+    troopers.for_each([&](const ConcurrentElement& e) {
+        const unsigned t = static_cast<unsigned>(e.prefix[0] - 'A');
+        if (t >= n_producers || e.prefix[1] != 'P' || e.operating_number % 2 != 0) ok = false;
+        else seen[t * n_per_producer + e.operating_number]++;
+    });
+    for (size_t i{}; i < seen.size(); i++) {
+        if (seen[i] != (i % n_per_producer % 2 == 0 ? 1 : 0)) ok = false;
+    }
+    printf("stress test: %u producers, %u removers, 1 reader (%zu visits): %s\n",
+           n_producers, n_producers, reader_visits.load(), ok ? "ok" : "FAILED");
+    return ok;
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// n_threads producers insert `total` troopers while one reader sums the list.
+template <typename List>
+double throughput(unsigned n_threads, size_t total, long& reader_sum) {
+    List troopers;
+    std::atomic<bool> done{};
+    std::thread reader{ [&] {
+        while (!done) troopers.for_each([&](const auto& e) { reader_sum += e.operating_number; });
+    } };
+    const double ms = milliseconds([&] {
+        std::vector<std::thread> producers;
+        for (unsigned t{}; t < n_threads; t++) {
+            producers.emplace_back([&, t] {
+                for (size_t i{ t }; i < total; i += n_threads) troopers.push_front('T', 'K', static_cast<short>(i % 1000));
+            });
+        }
+        for (auto& producer : producers) producer.join();
+    });
+    done = true;
+    reader.join();
+    return total / ms / 1e3;  // million insertions per second
+}
+
+// Same as ch6/9_parallel_mean.cpp.
+std::vector<unsigned> thread_counts(unsigned max_threads) {
+    std::vector<unsigned> counts;
+    for (unsigned t{ 1 }; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+int main() {
+    ConcurrentTrooperList troopers;
+    troopers.push_front('X', 'Y', 103);
+    auto* first = troopers.push_front('A', 'B', 101);
+    {
+        Epochs::Guard guard{ epochs };
+        troopers.insert_next(first, new ConcurrentElement{ {}, { 'M', 'N' }, 102 });
+    }
+    troopers.for_each([](const ConcurrentElement& e) {
+        printf("Trooper %c%c, Nr:%d\n", e.prefix[0], e.prefix[1], e.operating_number);
+    });
+    troopers.remove('M', 'N', 102);
+    troopers.for_each([](const ConcurrentElement& e) {
+        printf("Trooper %c%c, Nr:%d\n", e.prefix[0], e.prefix[1], e.operating_number);
+    });
+    printf("\n");
+
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!stress_test(std::min(max_threads, 8u) + 1, 4000)) return 1;
+
+    const size_t total{ 2'000'000 };
+    printf("\n=== push_front of %zu troopers with one concurrent reader (M inserts/s) ===\n", total);
+    for (unsigned t : thread_counts(max_threads)) {
+        long sum_locked{}, sum_lock_free{};
+        const double locked = throughput<LockedTrooperList>(t, total, sum_locked);
+        const double lock_free = throughput<ConcurrentTrooperList>(t, total, sum_lock_free);
+        printf("%2u producers: mutex %6.2f, lock-free %6.2f  (reader sums %ld, %ld)\n",
+               t, locked, lock_free, sum_locked, sum_lock_free);
+    }
+    return 0;
+}
+
+/* TAKEAWAY
+* The lock-free list does not make a single insertion cheaper: a CAS costs about
+* as much as taking an uncontended mutex. What it buys is that a reader walking
+* a long list never holds up the writers (and the other way round), and a thread
+* that gets descheduled never blocks anybody. The price is the complexity above,
+* most of it for the question "when may I delete this?".
+*/
@@ -1,9 +1,15 @@
 #include <cstdio>
 
+#include "../ch2/struct_layout.h"
+
 struct College
 {
     char name[256];
 };
+// Layout budget, see ch2/struct_layout.h.
+template <>
+constexpr auto fields_of<College> = std::array{ FIELD(College, name) };
+static_assert(within_budget<College>(256, 0), "College grew.");
 
 void print_college(College* college_ptr) {
     printf("%s College\n", college_ptr->name);
@@ -0,0 +1,133 @@
+// Needs -std=c++20 because of concepts (see ch6/5).
+
+/* Streaming statistics
+* `mean` from ch6/5 needs the whole array in memory and only gives you the
+* average. For a stream of measurements you rather want an accumulator that you
+* `push` values into one by one, O(1) each, and ask for the statistics at any time.
+*
+* Welford's algorithm keeps a running mean and the running sum of squared
+* differences from that mean (m2). Compared to the textbook sum(x^2)/n - mean^2
+* it does not subtract two huge, almost equal numbers, so the variance stays
+* accurate even when the values are large and close together.
+*
+* Two accumulators can be merged (Chan et al.), so each thread or shard keeps
+* its own RunningStats and you combine them at the end. count, sum, min and max
+* merge exactly; mean and m2 merge with the same formula Welford uses for one
+* value, just with a whole batch on the other side.
+*/
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdio>
+#include <type_traits>
+#include <vector>
+
+// Same concept as ch6/5.
+template <typename T>
+concept Averagable =  std::is_default_constructible_v<T>
+    && requires (T a, T b) {
+        { a += b } -> std::same_as<T&>;  // compound assignment returns a reference
+        { a / size_t{ 1 }} -> std::same_as<T>;
+    };
+
+// On top of Averagable we need to compare values (min/max) and convert them to
+// double (mean/variance of a size_t stream is not a size_t).
+template <Averagable T>
+    requires std::totally_ordered<T> && std::convertible_to<T, double>
+struct RunningStats {
+    void push(const T& value) {
+        if (n == 0 || value < minimum) minimum = value;
+        if (n == 0 || maximum < value) maximum = value;
+        n++;
+        total += value;
+        const double x = static_cast<double>(value);
+        const double delta = x - running_mean;
+        running_mean += delta / n;
+        m2 += delta * (x - running_mean);
+    }
+
+    void merge(const RunningStats& other) {
+        if (other.n == 0) return;
+        if (n == 0) {
+            *this = other;
+            return;
+        }
+        if (other.minimum < minimum) minimum = other.minimum;
+        if (maximum < other.maximum) maximum = other.maximum;
+        const size_t merged_n = n + other.n;
+        const double delta = other.running_mean - running_mean;
+        running_mean += delta * other.n / merged_n;
+        m2 += other.m2 + delta * delta * n * other.n / merged_n;
+        total += other.total;
+        n = merged_n;
+    }
+
+    size_t count() const { return n; }
+    T sum() const { return total; }  // same wrap-around behavior as ch6/5 for integers
+    T min() const { return minimum; }
+    T max() const { return maximum; }
+    double mean() const { return running_mean; }
+    // population variance (divide by n); sample variance divides by n - 1.
+    double variance() const { return n ? m2 / n : 0.0; }
+    double sample_variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+
+private:
+    size_t n{};
+    T total{};
+    T minimum{};
+    T maximum{};
+    double running_mean{};
+    double m2{};
+};
+
+int main() {
+    RunningStats<double> stats;
+    for (double x : { 1.0, 2.0, 3.0, 4.0 }) stats.push(x);
+    printf("double: n=%zu mean=%f var=%f min=%f max=%f\n",
+           stats.count(), stats.mean(), stats.variance(), stats.min(), stats.max());
+
+    // Numerical stability: 1e9+1 .. 1e9+4 have variance exactly 1.25.
+    // The naive sum of squares loses all digits here, Welford does not.
+    RunningStats<double> offset;
+    for (double x : { 1e9 + 1, 1e9 + 2, 1e9 + 3, 1e9 + 4 }) offset.push(x);
+    printf("offset by 1e9: var=%f (expected 1.25)\n", offset.variance());
+
+    // Merging per-shard accumulators gives the same answer as one accumulator.
+    RunningStats<size_t> left, right, all;
+    for (size_t i{ 1 }; i <= 10; i++) {
+        (i <= 4 ? left : right).push(i);
+        all.push(i);
+    }
+    left.merge(right);
+    printf("size_t merged: n=%zu sum=%zu mean=%f var=%f | single: mean=%f var=%f\n",
+           left.count(), left.sum(), left.mean(), left.variance(), all.mean(), all.variance());
+
+    // Benchmark: push throughput and merge cost.
+    const size_t n{ 1 << 24 };
+    std::vector<double> data(n);
+    for (size_t i{}; i < n; i++) data[i] = static_cast<double>((i * 2654435761u) % 100000);
+
+    RunningStats<double> bench;
+    auto start = std::chrono::steady_clock::now();
+    for (double x : data) bench.push(x);
+    auto stop = std::chrono::steady_clock::now();
+    const double push_ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    printf("\npush: %zu values in %.2f ms -> %.1f M values/s (mean=%f)\n",
+           n, push_ns / 1e6, n / push_ns * 1e3, bench.mean());
+
+    const size_t n_shards{ 1 << 20 };
+    std::vector<RunningStats<double>> shards(n_shards, bench);
+    RunningStats<double> merged;
+    start = std::chrono::steady_clock::now();
+    for (const auto& shard : shards) merged.merge(shard);
+    stop = std::chrono::steady_clock::now();
+    const double merge_ns = std::chrono::duration<double, std::nano>(stop - start).count();
+    printf("merge: %zu accumulators in %.2f ms -> %.2f ns/merge (mean=%f)\n",
+           n_shards, merge_ns / 1e6, merge_ns / n_shards, merged.mean());
+}
+
+/* TAKEAWAY
+* push does one division per value, which dominates its cost; merge is a few
+* flops regardless of how many values each side has seen. So keep one
+* accumulator per thread and merge once at the end instead of sharing one.
+*/
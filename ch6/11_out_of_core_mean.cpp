@@ -0,0 +1,280 @@
+/* Out-of-core mean
+* The `mean` template from ch6/1 takes a pointer and a length, so it does not
+* care where the values live. If the column is stored in a file that is larger
+* than RAM, we can let the operating system page it in for us with `mmap` and
+* feed the mapped memory to the same loop, one chunk at a time.
+*
+* Two ways of reading the file are shown (POSIX only):
+* 1. mmap + madvise(MADV_SEQUENTIAL): tells the kernel we read front to back,
+*    so it reads ahead aggressively and drops pages behind us early. Already
+*    consumed chunks are released with MADV_DONTNEED so the resident set stays
+*    small even for a file bigger than RAM.
+* 2. pread into two buffers ('double buffering'): while the main thread sums one
+*    buffer, a helper thread reads the next chunk into the other one. Useful on
+*    file systems where mmap is slow or not allowed.
+*
+* File format: either a raw little-endian array of T, or a 16 byte header
+* (magic "COL1", uint32 element size, uint64 element count) followed by the data.
+*
+* Sums of the chunks are added up and divided once at the end, so for size_t the
+* result (including wrap-around) is exactly what ch6/1 gives on the whole array.
+*
+* compile: `g++ -std=c++20 -O2 -pthread 11_out_of_core_mean.cpp -o ooc_mean`
+* run:     `./ooc_mean column_file` reads an existing column of doubles;
+*          `./ooc_mean [-n n_elements]` writes a test column to a temporary
+*          file first (chunk by chunk, so it may be larger than RAM).
+* For cold-cache numbers drop the page cache between runs (as root):
+* `sync; echo 3 > /proc/sys/vm/drop_caches`.
+*/
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::endian::native == std::endian::little,
+              "column files are little-endian; add a byte swap for this platform.");
+
+// Same as ch6/1.
+template <typename T>
+T mean(const T* values, size_t length) {
+    T result{};
+    for(size_t i{}; i < length; i++) {
+        result += values[i];
+    }
+    return result/length;
+}
+
+// The loop of `mean` without the division, so chunk results can be added up.
+template <typename T>
+T sum(const T* values, size_t length) {
+    T result{};
+    for(size_t i{}; i < length; i++) {
+        result += values[i];
+    }
+    return result;
+}
+
+struct ColumnHeader {
+    char magic[4];
+    uint32_t element_size;
+    uint64_t count;
+};
+static_assert(sizeof(ColumnHeader) == 16);
+
+// RAII file descriptor (CADRe, see ch4/6).
+struct File {
+    File(const char* path, int flags, mode_t mode = 0644)
+        : fd{ open(path, flags, mode) } {
+        if (fd < 0) throw std::runtime_error{ "Cannot open file." };
+    }
+    ~File() { close(fd); }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    size_t size() const {
+        struct stat st;
+        if (fstat(fd, &st) != 0) throw std::runtime_error{ "Cannot stat file." };
+        return static_cast<size_t>(st.st_size);
+    }
+    int fd;
+};
+
+// write() moves at most about 2 GB per call, and may move less than asked.
+void write_all(int fd, const void* data, size_t bytes) {
+    auto in = static_cast<const char*>(data);
+    while (bytes > 0) {
+        const ssize_t put = write(fd, in, bytes);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) throw std::runtime_error{ "write failed." };
+        in += put;
+        bytes -= static_cast<size_t>(put);
+    }
+}
+
+// A private file (mkstemp: unique name, mode 0600) that is removed again.
+struct TemporaryFile {
+    explicit TemporaryFile(const char* prefix)
+        : path{ std::string{ "/tmp/" } + prefix + "_XXXXXX" } {
+        const int fd = mkstemp(path.data());
+        if (fd < 0) throw std::runtime_error{ "Cannot create temporary file." };
+        close(fd);
+    }
+    ~TemporaryFile() { unlink(path.c_str()); }
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+    std::string path;
+};
+
+// Where the values start and how many there are.
+template <typename T>
+struct ColumnLayout {
+    size_t offset;
+    size_t count;
+};
+
+template <typename T>
+ColumnLayout<T> read_layout(const File& file) {
+    const size_t file_size = file.size();
+    ColumnHeader header{};
+    if (file_size >= sizeof(header)
+        && pread(file.fd, &header, sizeof(header), 0) == sizeof(header)
+        && std::memcmp(header.magic, "COL1", 4) == 0) {
+        if (header.element_size != sizeof(T)) throw std::runtime_error{ "Element size mismatch." };
+        if (header.count > (file_size - sizeof(header)) / sizeof(T))
+            throw std::runtime_error{ "Truncated column file." };
+        return { sizeof(header), header.count };
+    }
+    if (file_size % sizeof(T) != 0) throw std::runtime_error{ "File size is not a multiple of sizeof(T)." };
+    return { 0, file_size / sizeof(T) };
+}
+
+constexpr size_t default_chunk_bytes{ size_t{ 64 } << 20 };  // 64 MB
+
+template <typename T>
+T mean_mmap(const char* path, size_t chunk_bytes = default_chunk_bytes) {
+    File file{ path, O_RDONLY };
+    const auto layout = read_layout<T>(file);
+    if (layout.count == 0) throw std::runtime_error{ "Empty column." };
+    const size_t map_size = layout.offset + layout.count * sizeof(T);
+    void* map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, file.fd, 0);
+    if (map == MAP_FAILED) throw std::runtime_error{ "mmap failed." };
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    const auto base = static_cast<const char*>(map);
+    const auto values = reinterpret_cast<const T*>(base + layout.offset);
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t chunk = std::max<size_t>(chunk_bytes / sizeof(T), 1);
+    T total{};
+    for (size_t begin{}; begin < layout.count; begin += chunk) {
+        const size_t length = std::min(chunk, layout.count - begin);
+        total += sum(values + begin, length);
+        // Give the pages we are done with back; keep the resident set small.
+        const size_t done = (layout.offset + (begin + length) * sizeof(T)) / page * page;
+        madvise(map, done, MADV_DONTNEED);
+    }
+    munmap(map, map_size);
+    return total/layout.count;
+}
+
+template <typename T>
+T mean_pread(const char* path, size_t chunk_bytes = default_chunk_bytes) {
+    File file{ path, O_RDONLY };
+    const auto layout = read_layout<T>(file);
+    if (layout.count == 0) throw std::runtime_error{ "Empty column." };
+    posix_fadvise(file.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t chunk = std::max<size_t>(chunk_bytes / sizeof(T), 1);
+    // No bigger than the column, and not zeroed: pread overwrites them anyway.
+    const size_t buffer_size = std::min(chunk, layout.count);
+    std::unique_ptr<T[]> buffers[2]{ std::make_unique_for_overwrite<T[]>(buffer_size),
+                                     std::make_unique_for_overwrite<T[]>(buffer_size) };
+    auto read_chunk = [&](size_t begin, T* buffer) {
+        const size_t length = std::min(chunk, layout.count - begin);
+        auto out = reinterpret_cast<char*>(buffer);
+        size_t bytes = length * sizeof(T);
+        off_t at = static_cast<off_t>(layout.offset + begin * sizeof(T));
+        while (bytes > 0) {
+            const ssize_t got = pread(file.fd, out, bytes, at);
+            if (got <= 0) throw std::runtime_error{ "pread failed." };
+            out += got;
+            at += got;
+            bytes -= static_cast<size_t>(got);
+        }
+        return length;
+    };
+
+    T total{};
+    auto pending = std::async(std::launch::async, read_chunk, size_t{}, buffers[0].get());
+    for (size_t begin{}, current{}; begin < layout.count; begin += chunk, current ^= 1) {
+        const size_t length = pending.get();
+        if (begin + chunk < layout.count)  // start reading the next chunk right away
+            pending = std::async(std::launch::async, read_chunk, begin + chunk, buffers[current ^ 1].get());
+        total += sum(buffers[current].get(), length);
+    }
+    return total/layout.count;
+}
+
+template <typename F>
+double seconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A test column with a header, values 0..999 repeating. Written one chunk at
+// a time, so it may be larger than RAM.
+void write_test_column(const char* path, size_t n) {
+    File out{ path, O_WRONLY | O_TRUNC };
+    const ColumnHeader header{ { 'C', 'O', 'L', '1' }, sizeof(double), n };
+    write_all(out.fd, &header, sizeof(header));
+    std::vector<double> chunk(std::min(n, default_chunk_bytes / sizeof(double)));
+    for (size_t begin{}; begin < n; begin += chunk.size()) {
+        const size_t length = std::min(chunk.size(), n - begin);
+        for (size_t i{}; i < length; i++) chunk[i] = static_cast<double>((begin + i) % 1000);
+        write_all(out.fd, chunk.data(), length * sizeof(double));
+    }
+}
+
+int main(int argc, char** argv) {
+    // A column file given on the command line is only read. Without one, a
+    // test column of n doubles goes to a private temporary file.
+    const bool generate = argc < 2 || std::strcmp(argv[1], "-n") == 0;
+    const size_t n = argc > 2 && generate ? std::strtoull(argv[2], nullptr, 10) : size_t{ 1 } << 25;
+    std::unique_ptr<TemporaryFile> temporary;
+    if (generate) {
+        temporary = std::make_unique<TemporaryFile>("ooc_mean");
+        write_test_column(temporary->path.c_str(), n);
+    }
+    const char* path = generate ? temporary->path.c_str() : argv[1];
+
+    try {
+        // Ceiling: the same loop over the first chunk, already read into RAM.
+        size_t count{}, in_memory_count{};
+        std::unique_ptr<double[]> first_chunk;
+        {
+            File file{ path, O_RDONLY };
+            const auto layout = read_layout<double>(file);
+            count = layout.count;
+            in_memory_count = std::min(count, default_chunk_bytes / sizeof(double));
+            first_chunk = std::make_unique_for_overwrite<double[]>(in_memory_count);
+            const size_t bytes = in_memory_count * sizeof(double);
+            if (pread(file.fd, first_chunk.get(), bytes, static_cast<off_t>(layout.offset)) != static_cast<ssize_t>(bytes))
+                throw std::runtime_error{ "pread failed." };
+        }
+        const double gb = count * sizeof(double) / 1e9;
+        double in_memory{}, mapped{}, preaded{};
+        const double t_mem = seconds([&] { in_memory = mean(first_chunk.get(), in_memory_count); });
+        const double t_mmap = seconds([&] { mapped = mean_mmap<double>(path); });
+        const double t_pread = seconds([&] { preaded = mean_pread<double>(path); });
+        printf("%zu doubles (%.2f GB)%s\n", count, gb, generate ? ", generated" : "");
+        printf("in memory (ceiling): %6.2f GB/s  mean=%f of the first %zu values\n",
+               in_memory_count * sizeof(double) / 1e9 / t_mem, in_memory, in_memory_count);
+        printf("mmap + madvise:      %6.2f GB/s  mean=%f\n", gb / t_mmap, mapped);
+        printf("pread, 2 buffers:    %6.2f GB/s  mean=%f\n", gb / t_pread, preaded);
+
+        if (generate) mean_mmap<float>(path);  // the header says double
+    } catch(const std::runtime_error& e) {
+        printf("Exception: %s\n", e.what());
+    }
+}
+
+/* TAKEAWAY
+* When the file is in the page cache both readers approach the in-memory
+* number; when it is not, both are capped by the disk and the sum loop is idle
+* most of the time. The chunked design keeps memory use flat either way.
+*/
@@ -0,0 +1,176 @@
+/* Fused reductions with variadic templates
+* The `mean` loop in ch6/1 and the `maximum` loop in ch2/builtin_types_and_sizeof
+* each walk the whole array. Want sum, min, max and a histogram? That's four
+* passes, and on a big array every pass pulls all the bytes from memory again.
+* Memory is the bottleneck, not the additions.
+*
+* With a variadic template (ch6/8) we can hand the function a compile-time list
+* of 'reducers' and let it apply all of them to each element while the element
+* is in a register. One pass over memory, however many reducers you ask for:
+*
+*     auto [sum, min, max] = reduce<Sum, Min, Max>(values);
+*
+* A reducer is any class template with `push(value)` and `result()`. Reducers
+* that need arguments (Histogram) are passed as objects to `reduce_with`.
+*/
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+template <typename T>
+struct Sum {
+    void push(T value) { total += value; }
+    T result() const { return total; }
+private:
+    T total{};
+};
+
+template <typename T>
+struct Count {
+    void push(T) { n++; }
+    size_t result() const { return n; }
+private:
+    size_t n{};
+};
+
+// Same result as ch6/1's mean, including integer division and wrap-around.
+template <typename T>
+struct Mean {
+    void push(T value) { total += value; n++; }
+    T result() const { return n ? total/n : T{}; }
+private:
+    T total{};
+    size_t n{};
+};
+
+template <typename T>
+struct Min {
+    void push(T value) { if (value < minimum) minimum = value; }
+    T result() const { return minimum; }
+private:
+    T minimum{ std::numeric_limits<T>::max() };
+};
+
+template <typename T>
+struct Max {
+    void push(T value) { if (maximum < value) maximum = value; }
+    T result() const { return maximum; }
+private:
+    T maximum{ std::numeric_limits<T>::lowest() };
+};
+
+// Fixed number of equally wide bins over [low, high). Values outside are clamped
+// into the first or last bin, NaN goes into the first.
+template <typename T, size_t Bins = 16>
+struct Histogram {
+    Histogram(T low, T high)
+        : low{ low }, scale{ Bins / (static_cast<double>(high) - static_cast<double>(low)) } {
+        if (!(low < high)) throw std::invalid_argument{ "Histogram needs low < high." };
+    }
+    void push(T value) {
+        const double position = (static_cast<double>(value) - static_cast<double>(low)) * scale;
+        // Clamp while still a double: converting NaN or a too large value to
+        // size_t is undefined.
+        size_t bin;
+        if (!(position > 0)) bin = 0;
+        else if (position >= Bins) bin = Bins - 1;
+        else bin = static_cast<size_t>(position);
+        counts[bin]++;
+    }
+    const std::array<size_t, Bins>& result() const { return counts; }
+private:
+    T low;
+    double scale;
+    std::array<size_t, Bins> counts{};
+};
+
+// The engine: one loop, every reducer sees every element ('fold expression' over
+// the parameter pack).
+template <typename T, typename... Reducers>
+std::tuple<Reducers...> reduce_with(std::span<const T> values, Reducers... reducers) {
+    for (const T& value : values) {
+        (reducers.push(value), ...);
+    }
+    return { reducers... };
+}
+
+// Convenience form with default constructed reducers, returning their results.
+// 'template template parameters': each Reducer is a template, we instantiate it with T.
+template <template <typename> typename... Reducers, typename T>
+auto reduce(std::span<const T> values) {
+    const auto reducers = reduce_with<T>(values, Reducers<T>{}...);
+    return std::apply([](const auto&... r) { return std::make_tuple(r.result()...); }, reducers);
+}
+
+template <template <typename> typename... Reducers, typename T>
+auto reduce(const std::vector<T>& values) {
+    return reduce<Reducers...>(std::span<const T>{ values });
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    const std::vector<unsigned long> values{ 10, 20, 30, 40, 0 };
+    const auto [sum, min, max, count, mean] = reduce<Sum, Min, Max, Count, Mean>(values);
+    printf("sum=%lu min=%lu max=%lu count=%zu mean=%lu\n", sum, min, max, count, mean);
+
+    // Values outside of [low, high) and NaN are clamped, an empty range is refused.
+    const std::vector<double> odd{ -1e300, std::numeric_limits<double>::quiet_NaN(), 5, 1e300 };
+    const auto odd_hist = std::get<0>(reduce_with(std::span<const double>{ odd }, Histogram<double, 4>{ 0, 8 })).result();
+    printf("histogram: %zu %zu %zu %zu\n", odd_hist[0], odd_hist[1], odd_hist[2], odd_hist[3]);
+    try {
+        Histogram<double>{ 1, 1 };
+    } catch (const std::invalid_argument& e) {
+        printf("Exception: %s\n", e.what());
+    }
+
+    // Benchmark: separate passes vs. one fused pass over a column much larger
+    // than the caches.
+    const size_t n{ size_t{ 1 } << 25 };
+    std::vector<double> column(n);
+    for (size_t i{}; i < n; i++) column[i] = static_cast<double>((i * 2654435761u) % 100000);
+    const std::span<const double> span{ column };
+
+    double s{}, lo{}, hi{};
+    size_t c{};
+    std::array<size_t, 16> hist{};
+    const double separate = milliseconds([&] {
+        s = std::get<0>(reduce<Sum>(span));
+        lo = std::get<0>(reduce<Min>(span));
+        hi = std::get<0>(reduce<Max>(span));
+        c = std::get<0>(reduce<Count>(span));
+        hist = std::get<0>(reduce_with(span, Histogram<double>{ 0, 100000 })).result();
+    });
+    printf("\nseparate: %.2f ms  sum=%.0f min=%.0f max=%.0f count=%zu bin0=%zu\n",
+           separate, s, lo, hi, c, hist[0]);
+
+    const double fused = milliseconds([&] {
+        const auto [r_sum, r_min, r_max, r_count, r_hist] = reduce_with(span,
+            Sum<double>{}, Min<double>{}, Max<double>{}, Count<double>{}, Histogram<double>{ 0, 100000 });
+        s = r_sum.result();
+        lo = r_min.result();
+        hi = r_max.result();
+        c = r_count.result();
+        hist = r_hist.result();
+    });
+    printf("fused:    %.2f ms  sum=%.0f min=%.0f max=%.0f count=%zu bin0=%zu\n",
+           fused, s, lo, hi, c, hist[0]);
+    printf("speedup:  %.2fx\n", separate / fused);
+}
+
+/* TAKEAWAY
+* The fused loop reads the data once. The more reducers you fuse, the more the
+* saving approaches "number of reducers" times -- as long as the work per element
+* stays cheaper than loading it from memory.
+*/
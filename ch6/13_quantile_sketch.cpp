@@ -0,0 +1,195 @@
+// Needs -std=c++20 because of concepts (see ch6/5).
+
+/* Streaming approximate quantiles (KLL sketch)
+* p50/p95/p99 of a series exactly means keeping and sorting all of it. A
+* 'sketch' keeps a small, bounded sample instead and answers with a known error.
+*
+* KLL (Karnin, Lang, Liberty 2016) keeps a stack of 'compactors'. New values go
+* into level 0. When a level is full it is sorted, every second item (randomly
+* the odd or the even ones) moves up one level and the rest are thrown away.
+* An item on level h stands for 2^h original values. Lower levels get smaller
+* capacities (factor 2/3 per level down), so the total memory is about 3*k
+* items, independent of how many values you push.
+*
+* Error bound: the 'rank' of the answer to quantile(q) is within eps*n of q*n.
+* eps shrinks like 1/k; for k = 200 it is below about 1.7% with 99% confidence
+* (the DataSketches KLL documentation has the table), and typical errors are a
+* lot smaller -- the benchmark prints them. It is a rank error, not a value
+* error: quantile(0.99) returns a value whose true rank is in [0.99 - eps, 0.99 + eps].
+*
+* Like RunningStats (ch6/10) sketches merge: per-thread sketches can be
+* combined and the error bound still holds for the merged stream.
+*
+* compile: `g++ -std=c++20 -O2 13_quantile_sketch.cpp -o kll`
+* run:     `./kll [n1 n2 ...]` e.g. `./kll 10000000 1000000000` (exact sorting is
+*          skipped above 200M elements; it would need the whole series in RAM).
+*/
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Same concept as ch6/5.
+template <typename T>
+concept Averagable =  std::is_default_constructible_v<T>
+    && requires (T a, T b) {
+        { a += b } -> std::same_as<T&>;
+        { a / size_t{ 1 }} -> std::same_as<T>;
+    };
+
+template <Averagable T>
+    requires std::totally_ordered<T>
+struct QuantileSketch {
+    QuantileSketch(size_t k = 200, uint64_t seed = 0x9E3779B97F4A7C15ull)
+        : k{ k < 8 ? 8 : k }, random_state{ seed ? seed : 1 } {
+        grow();
+    }
+
+    void push(const T& value) {
+        levels[0].push_back(value);
+        n++;
+        if (++stored >= max_stored) compress();
+    }
+
+    void merge(const QuantileSketch& other) {
+        while (levels.size() < other.levels.size()) grow();
+        for (size_t h{}; h < other.levels.size(); h++) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        n += other.n;
+        stored += other.stored;
+        while (stored >= max_stored) compress();
+    }
+
+    // q in [0, 1]. Returns T{} for an empty sketch.
+    T quantile(double q) const {
+        std::vector<std::pair<T, uint64_t>> weighted;
+        weighted.reserve(stored);
+        for (size_t h{}; h < levels.size(); h++) {
+            for (const T& item : levels[h]) weighted.emplace_back(item, uint64_t{ 1 } << h);
+        }
+        if (weighted.empty()) return T{};
+        std::sort(weighted.begin(), weighted.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        uint64_t total{};
+        for (const auto& item : weighted) total += item.second;
+        const double target = std::clamp(q, 0.0, 1.0) * static_cast<double>(total);
+        uint64_t cumulative{};
+        for (const auto& item : weighted) {
+            cumulative += item.second;
+            if (static_cast<double>(cumulative) >= target) return item.first;
+        }
+        return weighted.back().first;
+    }
+
+    size_t count() const { return n; }
+    size_t retained() const { return stored; }  // items actually kept
+    size_t memory_bytes() const {
+        size_t bytes{ sizeof(*this) + levels.capacity() * sizeof(levels[0]) };
+        for (const auto& level : levels) bytes += level.capacity() * sizeof(T);
+        return bytes;
+    }
+
+private:
+    size_t capacity(size_t h) const {
+        const size_t depth = levels.size() - h - 1;
+        return static_cast<size_t>(std::ceil(std::pow(2.0 / 3.0, static_cast<double>(depth)) * k)) + 1;
+    }
+
+    void grow() {
+        levels.emplace_back();
+        max_stored = 0;
+        for (size_t h{}; h < levels.size(); h++) max_stored += capacity(h);
+    }
+
+    bool coin_flip() {  // xorshift64, one random bit per compaction is plenty
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        return random_state & 1;
+    }
+
+    // Compact the lowest full level into the one above it.
+    void compress() {
+        for (size_t h{}; h < levels.size(); h++) {
+            if (levels[h].size() < capacity(h)) continue;
+            if (h + 1 == levels.size()) grow();
+            auto& level = levels[h];
+            auto& above = levels[h + 1];
+            std::sort(level.begin(), level.end());
+            // With an odd size, the largest item stays behind on this level.
+            const size_t even_size = level.size() & ~size_t{ 1 };
+            for (size_t i = coin_flip() ? 1 : 0; i < even_size; i += 2) above.push_back(level[i]);
+            level.erase(level.begin(), level.begin() + static_cast<std::ptrdiff_t>(even_size));
+            stored -= even_size / 2;
+            return;
+        }
+    }
+
+    size_t k;
+    uint64_t random_state;
+    std::vector<std::vector<T>> levels;
+    size_t n{};
+    size_t stored{};
+    size_t max_stored{};
+};
+
+// Deterministic pseudo random series (no storage needed for the 1B run).
+double series(size_t i) {
+    uint64_t x = i * 0x9E3779B97F4A7C15ull;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return static_cast<double>(x % 1000000) / 100.0;
+}
+
+void benchmark(size_t n) {
+    const double qs[] { 0.5, 0.95, 0.99 };
+    QuantileSketch<double> sketch;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i{}; i < n; i++) sketch.push(series(i));
+    const double push_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\n=== n = %zu ===\n", n);
+    printf("sketch: %.1f M pushes/s, %zu items kept, %zu bytes\n",
+           n / push_s / 1e6, sketch.retained(), sketch.memory_bytes());
+
+    if (n > 200'000'000) {
+        printf("exact:  skipped (would need %.1f GB)\n", n * sizeof(double) / 1e9);
+        for (double q : qs) printf("  p%-4g sketch=%.2f\n", q * 100, sketch.quantile(q));
+        return;
+    }
+    start = std::chrono::steady_clock::now();
+    std::vector<double> copy(n);
+    for (size_t i{}; i < n; i++) copy[i] = series(i);
+    std::sort(copy.begin(), copy.end());
+    const double sort_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("exact:  %.1f M values/s (fill + sort), %zu bytes\n", n / sort_s / 1e6, n * sizeof(double));
+    for (double q : qs) {
+        const double approx = sketch.quantile(q);
+        const double rank = static_cast<double>(std::lower_bound(copy.begin(), copy.end(), approx) - copy.begin()) / n;
+        printf("  p%-4g sketch=%.2f exact=%.2f rank error=%.4f\n",
+               q * 100, approx, copy[static_cast<size_t>(q * (n - 1))], std::fabs(rank - q));
+    }
+}
+
+int main(int argc, char** argv) {
+    // Two shards merged vs. one sketch over everything.
+    QuantileSketch<double> left, right;
+    for (size_t i{}; i < 100000; i++) (i % 2 ? left : right).push(static_cast<double>(i));
+    left.merge(right);
+    printf("0..99999 merged: p50=%.0f p95=%.0f p99=%.0f (exact 49999 94999 98999)\n",
+           left.quantile(0.5), left.quantile(0.95), left.quantile(0.99));
+
+    if (argc > 1) {
+        for (int i{ 1 }; i < argc; i++) benchmark(std::strtoull(argv[i], nullptr, 10));
+    } else {
+        benchmark(10'000'000);
+    }
+}
@@ -0,0 +1,227 @@
+/* Checked numeric text ingestion
+* Reading "from,to,amount" lines with `sscanf` and then calling `narrow_cast`
+* (ch6/0) on every field is slow: sscanf parses its format string on every
+* call, handles locales, and the value is converted twice.
+*
+* `std::from_chars` (<charconv>) is the low-level alternative: no locale, no
+* allocation, no format string. It parses straight into the target type, and if
+* the number does not fit that type it reports `result_out_of_range` instead
+* of silently wrapping. So the range check comes for free, and we turn it into
+* the same `std::runtime_error{ "Narrowed!" }` that narrow_cast throws.
+*
+* A row is parsed with a variadic template (ch6/8): `parse_row<long, long,
+* double>(cursor, end, ',')` returns a std::tuple with one value per field.
+* Fields are parsed straight out of the text buffer, so nothing is allocated
+* per field or per line.
+*
+* The rows are handed to the Bank from ch5/3 in batches.
+*
+* compile: `g++ -std=c++20 -O2 16_numeric_text_ingestion.cpp -o ingest`
+*/
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Same as ch6/0.
+template <typename To, typename From>
+To narrow_cast(From value) {
+    const auto converted = static_cast<To>(value);
+    const auto backward = static_cast<From>(converted);
+    if (value != backward) throw std::runtime_error("Narrowed!");
+    return converted;
+}
+
+// Parse one field at `cursor` and step over the following delimiter. The last
+// field of a row must be followed by the line end (or the end of the text)
+// instead, every other field by the delimiter.
+template <typename T>
+T parse_field(const char*& cursor, const char* end, char delimiter, bool last) {
+    T value{};
+    if (cursor != end && *cursor == '+') {  // from_chars does not accept a leading '+'
+        cursor++;
+        if (cursor != end && *cursor == '-') throw std::runtime_error("Not a number.");
+    }
+    const auto [ptr, error] = std::from_chars(cursor, end, value);
+    if (error == std::errc::result_out_of_range) throw std::runtime_error("Narrowed!");
+    if (error != std::errc{}) throw std::runtime_error("Not a number.");
+    cursor = ptr;
+    const bool line_end = cursor == end || *cursor == '\n' || *cursor == '\r';
+    if (last) {
+        if (cursor != end && *cursor == delimiter) throw std::runtime_error("Too many fields.");
+        if (!line_end) throw std::runtime_error("Unexpected character after number.");
+    } else if (cursor != end && *cursor == delimiter) {
+        cursor++;
+    } else {
+        throw std::runtime_error(line_end ? "Too few fields." : "Unexpected character after number.");
+    }
+    return value;
+}
+
+template <typename... Fields, size_t... Index>
+std::tuple<Fields...> parse_fields(const char*& cursor, const char* end, char delimiter, std::index_sequence<Index...>) {
+    // Braced initialization evaluates its elements left to right, so the fields
+    // are parsed in order.
+    return std::tuple<Fields...>{ parse_field<Fields>(cursor, end, delimiter, Index + 1 == sizeof...(Fields))... };
+}
+
+// Parse one row of fields of the given types and step to the next line.
+template <typename... Fields>
+std::tuple<Fields...> parse_row(const char*& cursor, const char* end, char delimiter) {
+    std::tuple<Fields...> row = parse_fields<Fields...>(cursor, end, delimiter, std::index_sequence_for<Fields...>{});
+    while (cursor != end && (*cursor == '\r' || *cursor == '\n')) cursor++;
+    return row;
+}
+
+// Same interfaces as ch5/3.
+struct Logger {
+    virtual ~Logger() = default;
+    virtual void log_transfer(long from, long to, double amount) = 0;
+};
+
+struct ConsoleLogger : Logger {
+    void log_transfer(long from, long to, double amount) override {
+        printf("[cons] %ld->%ld: %f\n", from, to, amount);
+    }
+};
+
+// Keeps a total instead of printing, so printing does not dominate the benchmark.
+struct TotalLogger : Logger {
+    void log_transfer(long, long, double amount) override {
+        total += amount;
+        count++;
+    }
+    double total{};
+    size_t count{};
+};
+
+struct Transfer {
+    long from;
+    long to;
+    double amount;
+};
+
+struct Bank {
+    Bank(Logger& logger) : logger{ logger } {};
+    void make_transfer(long from, long to, double amount) const {
+        logger.log_transfer(from, to, amount);
+    }
+    void make_transfers(const Transfer* transfers, size_t n_transfers) const {
+        for (size_t i{}; i < n_transfers; i++) {
+            make_transfer(transfers[i].from, transfers[i].to, transfers[i].amount);
+        }
+    }
+private:
+    Logger& logger;
+};
+
+// Parses `text` and sends it to the bank in batches of `batch_size` transfers.
+// A first line that does not start with a number is treated as a header.
+// Returns the number of transfers made.
+size_t load_transfers(std::string_view text, const Bank& bank, size_t batch_size = 4096) {
+    const char* cursor = text.data();
+    const char* end = text.data() + text.size();
+    if (cursor != end && !(*cursor == '-' || *cursor == '+' || (*cursor >= '0' && *cursor <= '9'))) {
+        while (cursor != end && *cursor != '\n') cursor++;
+        while (cursor != end && (*cursor == '\r' || *cursor == '\n')) cursor++;
+    }
+    std::vector<Transfer> batch;
+    batch.reserve(batch_size);
+    size_t total{};
+    while (cursor != end) {
+        const auto [from, to, amount] = parse_row<long, long, double>(cursor, end, ',');
+        batch.push_back({ from, to, amount });
+        if (batch.size() == batch_size) {
+            bank.make_transfers(batch.data(), batch.size());
+            total += batch.size();
+            batch.clear();
+        }
+    }
+    bank.make_transfers(batch.data(), batch.size());
+    return total + batch.size();
+}
+
+// The old way: one line at a time (like fgets), sscanf per line, narrow_cast
+// per field. The line is copied out first because sscanf calls strlen on its
+// input, which on one big buffer would make the loop quadratic.
+size_t load_transfers_sscanf(const std::string& text, const Bank& bank) {
+    size_t total{};
+    size_t position{};
+    char line[128];
+    while (position < text.size()) {
+        size_t line_end = text.find('\n', position);
+        if (line_end == std::string::npos) line_end = text.size();
+        const size_t length = std::min(line_end - position, sizeof(line) - 1);
+        text.copy(line, length, position);
+        line[length] = 0;
+        long long from{}, to{};
+        double amount{};
+        if (sscanf(line, "%lld,%lld,%lf", &from, &to, &amount) == 3) {
+            bank.make_transfer(narrow_cast<long>(from), narrow_cast<long>(to), amount);
+            total++;
+        }
+        position = line_end + 1;
+    }
+    return total;
+}
+
+int main() {
+    ConsoleLogger console;
+    Bank bank{ console };
+    const std::string_view text{ "from,to,amount\n1000,2000,49.95\n2000,3000,20.00\r\n" };
+    printf("loaded %zu transfers\n", load_transfers(text, bank));
+
+    // Parsing straight into a narrow type: 70000 does not fit into a short.
+    const std::string_view narrow{ "12,70000\n" };
+    try {
+        const char* cursor = narrow.data();
+        const auto [a, b] = parse_row<short, short>(cursor, narrow.data() + narrow.size(), ',');
+        printf("parsed %hd %hd\n", a, b);
+    } catch(const std::runtime_error& e) {
+        printf("Exception: %s\n", e.what());
+    }
+
+    // Malformed rows are errors, not silently different rows.
+    for (const std::string_view bad : { "1,2,3,4,5,6\n", "+-3,4,5\n", "1,2\n3\n" }) {
+        try {
+            const char* cursor = bad.data();
+            parse_row<long, long, long>(cursor, bad.data() + bad.size(), ',');
+            printf("accepted (WRONG): %.*s\n", static_cast<int>(bad.find('\n')), bad.data());
+        } catch(const std::runtime_error& e) {
+            printf("rejected: %.*s -> %s\n", static_cast<int>(bad.find('\n')), bad.data(), e.what());
+        }
+    }
+
+    // Benchmark on a generated file.
+    const size_t n_rows{ 2'000'000 };
+    std::string csv{ "from,to,amount\n" };
+    csv.reserve(n_rows * 32);
+    char line[64];
+    for (size_t i{}; i < n_rows; i++) {
+        const int length = snprintf(line, sizeof(line), "%zu,%zu,%zu.%02zu\n",
+                                    100000 + i % 900000, 100000 + (i * 7919) % 900000, i % 10000, i % 100);
+        csv.append(line, static_cast<size_t>(length));
+    }
+    const double mb = csv.size() / 1e6;
+
+    TotalLogger slow_total, fast_total;
+    auto start = std::chrono::steady_clock::now();
+    const size_t slow_rows = load_transfers_sscanf(csv, Bank{ slow_total });
+    const double t_slow = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    const size_t fast_rows = load_transfers(csv, Bank{ fast_total });
+    const double t_fast = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\n%.1f MB, %zu rows\n", mb, n_rows);
+    printf("sscanf + narrow_cast: %7.1f MB/s  rows=%zu total=%.2f\n", mb / t_slow, slow_rows, slow_total.total);
+    printf("from_chars:           %7.1f MB/s  rows=%zu total=%.2f\n", mb / t_fast, fast_rows, fast_total.total);
+    printf("speedup: %.2fx\n", t_slow / t_fast);
+}
@@ -0,0 +1,181 @@
+/* StaticVector: a vector with its storage inside the object
+* ch6/7 used a non-type template parameter `Length` to check `get<Index>` at
+* compile time. The same trick gives us a container with a fixed capacity N:
+* the elements live inside the object itself (on the stack, or inside whatever
+* object holds the StaticVector), so there is never a heap allocation, unlike
+* a small std::vector that allocates on its first push_back.
+*
+* - size() changes at runtime between 0 and N, the capacity N is fixed.
+* - The storage is an anonymous union around `T items[N]`: a union member is
+*   not constructed automatically, so an empty StaticVector<std::string, 8>
+*   constructs no strings. Elements are created with std::construct_at and
+*   destroyed with std::destroy_at, which (since C++20) also work at compile time.
+*   So everything here is `constexpr`.
+* - get<I>() checks I < N at compile time, like ch6/7.
+* - operator[] is checked in debug builds and unchecked with -DNDEBUG (the same
+*   switch `assert` uses). push_back on a full vector always throws.
+*
+* compile: `g++ -std=c++20 -O2 -DNDEBUG 17_static_vector.cpp -o static_vector`
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename T, size_t N>
+struct StaticVector {
+    constexpr StaticVector() {}  // constructs no elements
+    constexpr StaticVector(std::initializer_list<T> values) {
+        for (const auto& value : values) push_back(value);
+    }
+    constexpr StaticVector(const StaticVector& other) {
+        for (const auto& value : other) push_back(value);
+    }
+    constexpr StaticVector(StaticVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        for (auto& value : other) push_back(std::move(value));
+        other.clear();
+    }
+    constexpr StaticVector& operator=(const StaticVector& other) {
+        if (this == &other) return *this;
+        clear();
+        for (const auto& value : other) push_back(value);
+        return *this;
+    }
+    constexpr StaticVector& operator=(StaticVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this == &other) return *this;
+        clear();
+        for (auto& value : other) push_back(std::move(value));
+        other.clear();
+        return *this;
+    }
+    constexpr ~StaticVector() {
+        clear();
+    }
+
+    constexpr void push_back(const T& value) { emplace_back(value); }
+    constexpr void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    template <typename... Arguments>
+    constexpr T& emplace_back(Arguments&&... arguments) {
+        if (length == N) throw std::out_of_range{ "StaticVector is full." };
+        std::construct_at(items + length, std::forward<Arguments>(arguments)...);
+        return items[length++];
+    }
+
+    constexpr void pop_back() {
+        check(length > 0);
+        std::destroy_at(items + --length);
+    }
+    constexpr void clear() {
+        while (length > 0) std::destroy_at(items + --length);
+    }
+
+    constexpr T& operator[](size_t index) {
+        check(index < length);
+        return items[index];
+    }
+    constexpr const T& operator[](size_t index) const {
+        check(index < length);
+        return items[index];
+    }
+
+    // Compile-time bounds check against the capacity (ch6/7); in debug builds
+    // also a runtime check against the current size.
+    template <size_t Index>
+    constexpr T& get() {
+        static_assert(Index < N, "Out-of-bounds access.");
+        check(Index < length);
+        return items[Index];
+    }
+
+    constexpr size_t size() const { return length; }
+    static constexpr size_t capacity() { return N; }
+    constexpr bool empty() const { return length == 0; }
+    constexpr bool full() const { return length == N; }
+
+    constexpr T* begin() { return items; }
+    constexpr T* end() { return items + length; }
+    constexpr const T* begin() const { return items; }
+    constexpr const T* end() const { return items + length; }
+
+private:
+    static constexpr void check(bool in_bounds) {
+#ifndef NDEBUG
+        if (!in_bounds) throw std::out_of_range{ "Out of Bounds." };
+#else
+        (void)in_bounds;
+#endif
+    }
+
+    union {
+        T items[N];
+    };
+    size_t length{};
+};
+
+// Free function version, same shape as get<Index>(arr) in ch6/7.
+template <size_t Index, typename T, size_t N>
+constexpr T& get(StaticVector<T, N>& vector) {
+    return vector.template get<Index>();
+}
+
+// Everything works at compile time.
+constexpr int sum_of_fibonacci() {
+    StaticVector<int, 8> fib{ 1, 1 };
+    while (!fib.full()) fib.push_back(fib[fib.size() - 1] + fib[fib.size() - 2]);
+    int total{};
+    for (int value : fib) total += value;
+    return total;
+}
+static_assert(sum_of_fibonacci() == 54);
+
+template <typename Vector>
+int hot_path(int seed) {
+    Vector values;
+    for (int i{}; i < 6; i++) values.push_back(seed + i);
+    int total{};
+    for (int value : values) total += value;
+    return total;
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+    StaticVector<int, 4> fib{ 1, 1, 2 };
+    fib.push_back(get<1>(fib) + get<2>(fib));
+    printf("%d %d %d %d\n", get<0>(fib), get<1>(fib), get<2>(fib), get<3>(fib));
+    // printf("%d", get<4>(fib));  // Bang! compile error, capacity is 4
+    try {
+        fib.push_back(5);
+    } catch(const std::out_of_range& e) {
+        printf("Exception: %s\n", e.what());
+    }
+
+    StaticVector<std::string, 3> names;
+    names.emplace_back("tokhchi");
+    names.emplace_back(3, 'z');
+    printf("%s %s (size %zu of %zu)\n", names[0].c_str(), names[1].c_str(), names.size(), names.capacity());
+
+    // Benchmark: a short-lived vector of six ints on a hot path.
+    const int n{ 10'000'000 };
+    long long heap_total{}, inline_total{};
+    const double t_heap = milliseconds([&] {
+        for (int i{}; i < n; i++) heap_total += hot_path<std::vector<int>>(i);
+    });
+    const double t_inline = milliseconds([&] {
+        for (int i{}; i < n; i++) inline_total += hot_path<StaticVector<int, 8>>(i);
+    });
+    printf("\nstd::vector<int>:       %7.2f ms  (%lld)\n", t_heap, heap_total);
+    printf("StaticVector<int, 8>:   %7.2f ms  (%lld)\n", t_inline, inline_total);
+    printf("speedup: %.2fx\n", t_heap / t_inline);
+}
@@ -0,0 +1,305 @@
+/* SimpleVector: growing a vector with type traits
+* When a vector runs out of capacity it allocates a bigger buffer and has to
+* 'relocate' every element into it. How to do that best depends on the type,
+* and type traits (ch6/4) let us decide at compile time with `if constexpr`:
+*
+* 1. Trivially copyable (Point, PodStruct): the object is just bytes, so one
+*    memcpy for the whole buffer is correct and the fastest option.
+* 2. noexcept move constructor (SimpleString from ch4/11): move every element.
+*    Cheap, it only steals the pointer.
+* 3. Move constructor that may throw: copy instead. If a move threw half-way,
+*    the old buffer would already be half moved-from and could not be restored.
+*    A copy that throws leaves the old buffer untouched, so push_back keeps the
+*    'strong guarantee'. This is the answer to ch4/11's question why the standard
+*    library copies when the move constructor is not `noexcept`.
+*
+* The same decision (std::move_if_noexcept) is what std::vector does; the
+* benchmark compares against it for all three kinds of types.
+*
+* compile: `g++ -std=c++20 -O2 18_relocating_simple_vector.cpp -o simple_vector`
+*/
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T>
+struct SimpleVector {
+    SimpleVector() = default;
+    ~SimpleVector() {
+        destroy(items, length);
+        deallocate(items);
+    }
+    // Only what this example needs: no copies, like SimpleUniquePointer (ch6/2).
+    SimpleVector(const SimpleVector&) = delete;
+    SimpleVector& operator=(const SimpleVector&) = delete;
+
+    template <typename... Arguments>
+    T& emplace_back(Arguments&&... arguments) {
+        if (length < max_size) {
+            new (items + length) T{ std::forward<Arguments>(arguments)... };
+            return items[length++];
+        }
+        // Full. `arguments` may refer to an element of this vector
+        // (v.push_back(v[0])), so build the new element in the new buffer
+        // before the old one is relocated and freed.
+        const size_t new_size = next_capacity();
+        T* new_items = allocate(new_size);
+        try {
+            new (new_items + length) T{ std::forward<Arguments>(arguments)... };
+        } catch(...) {
+            deallocate(new_items);
+            throw;
+        }
+        try {
+            relocate(items, length, new_items);
+        } catch(...) {
+            destroy(new_items + length, 1);
+            deallocate(new_items);
+            throw;
+        }
+        deallocate(items);
+        items = new_items;
+        max_size = new_size;
+        return items[length++];
+    }
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    // Insert before `index`, shifting the tail one slot to the right.
+    void insert(size_t index, T value) {
+        if (index > length) throw std::out_of_range{ "Out of Bounds." };
+        if (length == max_size) grow();
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            std::memmove(static_cast<void*>(items + index + 1), items + index, (length - index) * sizeof(T));
+            new (items + index) T{ std::move(value) };
+        } else if (index == length) {
+            new (items + length) T{ std::move(value) };
+        } else {
+            new (items + length) T{ std::move(items[length - 1]) };
+            for (size_t i{ length - 1 }; i > index; i--) items[i] = std::move(items[i - 1]);
+            items[index] = std::move(value);
+        }
+        length++;
+    }
+
+    T& operator[](size_t index) { return items[index]; }
+    size_t size() const { return length; }
+    size_t capacity() const { return max_size; }
+
+private:
+    static void destroy(T* first, size_t n) {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            for (size_t i{}; i < n; i++) first[i].~T();
+        }
+    }
+
+    // Move (or copy, or memcpy) n elements from `from` into uninitialized `to`.
+    static void relocate(T* from, size_t n, T* to) {
+        if constexpr (std::is_trivially_copyable_v<T>) {
+            if (n) std::memcpy(static_cast<void*>(to), from, n * sizeof(T));  // case 1
+        } else if constexpr (std::is_nothrow_move_constructible_v<T> || !std::is_copy_constructible_v<T>) {
+            for (size_t i{}; i < n; i++) new (to + i) T{ std::move(from[i]) };  // case 2
+            destroy(from, n);
+        } else {
+            size_t constructed{};  // case 3
+            try {
+                for (; constructed < n; constructed++) new (to + constructed) T{ from[constructed] };
+            } catch(...) {
+                destroy(to, constructed);  // old buffer untouched -> strong guarantee
+                throw;
+            }
+            destroy(from, n);
+        }
+    }
+
+    size_t next_capacity() const { return max_size ? 2 * max_size : 4; }
+    static T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ alignof(T) })); }
+    static void deallocate(T* p) { ::operator delete(p, std::align_val_t{ alignof(T) }); }
+
+    void grow() {
+        const size_t new_size = next_capacity();
+        T* new_items = allocate(new_size);
+        try {
+            relocate(items, length, new_items);
+        } catch(...) {
+            deallocate(new_items);
+            throw;
+        }
+        deallocate(items);
+        items = new_items;
+        max_size = new_size;
+    }
+
+    T* items{};
+    size_t length{};
+    size_t max_size{};
+};
+
+// Kind 1: trivially copyable (ch4/8 and ch2/class).
+struct Point {
+    int x, y;
+};
+
+struct PodStruct {
+    uint64_t number;
+    char string[256];
+    bool valid;
+};
+
+// Kind 2: SimpleString with copy (ch4/8) and noexcept move (ch4/11).
+class SimpleString {
+    size_t max_size;
+    char* buffer;
+    size_t length;
+
+public:
+    SimpleString(size_t max_size)
+        : max_size{ max_size },
+        length{} {
+            if (max_size == 0) {
+                throw std::runtime_error{ "max_size must be at least 1." };
+            }
+            buffer = new char[max_size];
+            buffer[0] = 0;
+    }
+    SimpleString(const SimpleString& other)
+     :  max_size{ other.max_size },
+        buffer{ new char[other.max_size] },
+        length{ other.length } {
+        std::strncpy(buffer, other.buffer, max_size);
+    }
+    SimpleString(SimpleString&& other) noexcept
+        : max_size{ other.max_size },
+        buffer{ other.buffer },
+        length{ other.length } {
+        other.max_size = 0;
+        other.buffer = nullptr;
+        other.length = 0;
+    }
+    SimpleString& operator=(const SimpleString& other) {
+        if (this == &other) return *this;
+        const auto new_buffer = new char[other.max_size];
+        delete[] buffer;
+        buffer = new_buffer;
+        length = other.length;
+        max_size = other.max_size;
+        std::strncpy(buffer, other.buffer, max_size);
+        return *this;
+    }
+    SimpleString& operator=(SimpleString&& other) noexcept {
+        if (this == &other) return *this;
+        delete[] buffer;
+        max_size = other.max_size;
+        buffer = other.buffer;
+        length = other.length;
+        other.max_size = 0;
+        other.length = 0;
+        other.buffer = nullptr;
+        return *this;
+    }
+    ~SimpleString() {
+        delete[] buffer;
+    }
+
+    bool append_line(const char* x) {
+        const auto x_len = strlen(x);
+        if (length + x_len + 2 > max_size) return false;
+        std::strncpy(buffer + length, x, max_size - length);
+        length += x_len;
+        buffer[length++] = '\n';
+        buffer[length] = 0;
+        return true;
+    }
+    const char* c_str() const { return buffer; }
+};
+
+// Kind 3: identical, but the move constructor is not marked noexcept.
+struct MaybeThrowingString : SimpleString {
+    using SimpleString::SimpleString;
+    MaybeThrowingString(const MaybeThrowingString&) = default;
+    MaybeThrowingString(MaybeThrowingString&& other) : SimpleString{ std::move(other) } {}
+    MaybeThrowingString& operator=(const MaybeThrowingString&) = default;
+    MaybeThrowingString& operator=(MaybeThrowingString&&) = default;
+};
+
+constexpr const char* strategy(bool trivial, bool nothrow_move) {
+    return trivial ? "memcpy" : nothrow_move ? "move" : "copy";
+}
+template <typename T>
+constexpr const char* strategy() {
+    return strategy(std::is_trivially_copyable_v<T>, std::is_nothrow_move_constructible_v<T>);
+}
+
+template <typename F>
+double milliseconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename T, typename Make>
+void benchmark(const char* name, size_t n_push, size_t n_insert, Make make) {
+    const T prototype = make();
+    const double simple_push = milliseconds([&] {
+        SimpleVector<T> v;
+        for (size_t i{}; i < n_push; i++) v.push_back(prototype);
+    });
+    const double std_push = milliseconds([&] {
+        std::vector<T> v;
+        for (size_t i{}; i < n_push; i++) v.push_back(prototype);
+    });
+    const double simple_insert = milliseconds([&] {
+        SimpleVector<T> v;
+        for (size_t i{}; i < n_insert; i++) v.insert(0, prototype);
+    });
+    const double std_insert = milliseconds([&] {
+        std::vector<T> v;
+        for (size_t i{}; i < n_insert; i++) v.insert(v.begin(), prototype);
+    });
+    printf("%-20s %-7s push_back x%zu: %8.2f ms (std::vector %8.2f ms)  insert(0) x%zu: %8.2f ms (std::vector %8.2f ms)\n",
+           name, strategy<T>(), n_push, simple_push, std_push, n_insert, simple_insert, std_insert);
+}
+
+int main() {
+    SimpleVector<SimpleString> strings;
+    for (const char* line : { "Starbuck! Whadya hear?", "Nothin' but the rain.", "Galactica!" }) {
+        SimpleString s{ 64 };
+        s.append_line(line);
+        strings.push_back(std::move(s));
+    }
+    SimpleString inserted{ 64 };
+    inserted.append_line("Grab your gun and bring the cat in.");
+    strings.insert(1, std::move(inserted));
+    for (size_t i{}; i < strings.size(); i++) printf("%zu: %s", i, strings[i].c_str());
+    printf("\n");
+
+    // Pushing one of its own elements while the vector is full: the element
+    // must be copied before the old buffer goes away.
+    while (strings.size() < strings.capacity()) strings.push_back(strings[0]);
+    strings.push_back(strings[0]);
+    SimpleVector<Point> points;
+    points.push_back(Point{ 7, 8 });
+    for (int i{}; i < 100; i++) points.push_back(points[points.size() - 1]);
+    bool aliased_ok = std::strcmp(strings[strings.size() - 1].c_str(), strings[0].c_str()) == 0;
+    for (size_t i{}; i < points.size(); i++) aliased_ok &= points[i].x == 7 && points[i].y == 8;
+    printf("push_back of an own element at full capacity: %s\n\n", aliased_ok ? "ok" : "WRONG");
+
+    const auto make_string = [] { SimpleString s{ 32 }; s.append_line("Grab your gun"); return s; };
+    const auto make_maybe = [] { MaybeThrowingString s{ 32 }; s.append_line("Grab your gun"); return s; };
+    benchmark<Point>("Point", 10'000'000, 20'000, [] { return Point{ 1, 2 }; });
+    benchmark<PodStruct>("PodStruct", 1'000'000, 5'000, [] { return PodStruct{ 20, "Hello World", false }; });
+    benchmark<SimpleString>("SimpleString", 1'000'000, 5'000, make_string);
+    benchmark<MaybeThrowingString>("MaybeThrowingString", 1'000'000, 5'000, make_maybe);
+}
+
+/* TAKEAWAY
+* Mark move constructors `noexcept` whenever they really cannot throw: it is
+* the difference between the 'move' and the 'copy' line above.
+*/
@@ -0,0 +1,363 @@
+/* Bulk serialization of trivially copyable records
+* PodStruct from ch2/class.cpp is 'trivially copyable' (std::is_trivially_copyable,
+* see the type traits in ch6/4): copying its bytes with memcpy gives a valid
+* copy. So an array of PodStructs does not need to be written field by field:
+* the whole array is one block of bytes, and one `write` (or one `read`, or an
+* `mmap`) moves all of it at the speed of the disk.
+*
+* That only works for the right types, so the functions are constrained with a
+* concept (ch6/5): a type with a std::string or a virtual function inside is
+* rejected at compile time, not at run time with corrupted data.
+*
+* Raw bytes are only meaningful to a reader with the same layout, so the file
+* starts with a header recording:
+* - the byte order of the writer,
+* - sizeof and alignof of the record,
+* - a 'schema hash' over the name, offset and size of every member (listed
+*   with FIELD from ch2/struct_layout.h). Reordering, resizing or renaming a
+*   member changes the hash, and the reader refuses the file.
+*
+* Note: trivially copyable does not mean 'meaningful on disk'. A struct with a
+* pointer member passes the check, but the pointer is useless in the next
+* process. The schema hash does not catch that either; do not list such types.
+*
+* compile: `g++ -std=c++20 -O2 19_pod_serialization.cpp -o pod_serialization`
+* run:     `./pod_serialization record_file` reads an existing record file;
+*          `./pod_serialization [-n n_records]` runs the benchmark on a
+*          temporary file, and damages it at the end to show the checks.
+*/
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../ch2/struct_layout.h"
+
+// Same as ch2/class.cpp.
+struct PodStruct {
+    uint64_t number;
+    char string[256];
+    bool valid;
+};
+
+// The members listed once, with FIELD from ch2/struct_layout.h.
+template <>
+constexpr auto fields_of<PodStruct> = std::array{
+    FIELD(PodStruct, number), FIELD(PodStruct, string), FIELD(PodStruct, valid) };
+
+// Trivially copyable, and the members are listed so there is a schema.
+template <typename T>
+concept Serializable = std::is_trivially_copyable_v<T> && std::is_standard_layout_v<T> && (fields_of<T>.size() > 0);
+
+// FNV-1a over the layout, computed by the compiler.
+template <Serializable T>
+constexpr uint64_t schema_hash() {
+    uint64_t h{ 0xcbf29ce484222325ull };
+    auto add = [&h](uint64_t value) {
+        for (int i{}; i < 8; i++) h = (h ^ ((value >> (8 * i)) & 0xFF)) * 0x100000001b3ull;
+    };
+    add(sizeof(T));
+    add(alignof(T));
+    for (const auto& field : fields_of<T>) {
+        for (const char* c = field.name; *c; c++) add(static_cast<unsigned char>(*c));
+        add(field.offset);
+        add(field.size);
+    }
+    return h;
+}
+
+struct RecordFileHeader {
+    char magic[4];
+    uint8_t little_endian;
+    uint8_t header_version;
+    uint16_t reserved;
+    uint32_t record_size;
+    uint32_t record_align;
+    uint64_t schema;
+    uint64_t count;
+};
+static_assert(sizeof(RecordFileHeader) == 32, "RecordFileHeader is a file format, it must not change.");
+
+// Records start here, so a mapped file is aligned for any record type.
+constexpr size_t records_offset{ 64 };
+
+template <Serializable T>
+constexpr RecordFileHeader header_for(uint64_t count) {
+    static_assert(alignof(T) <= records_offset);
+    return { { 'P', 'O', 'D', 'S' }, std::endian::native == std::endian::little, 1, 0,
+             sizeof(T), alignof(T), schema_hash<T>(), count };
+}
+
+template <Serializable T>
+void check_header(const RecordFileHeader& header) {
+    const RecordFileHeader expected = header_for<T>(header.count);
+    if (std::memcmp(header.magic, expected.magic, 4) != 0 || header.header_version != expected.header_version)
+        throw std::runtime_error{ "Not a record file." };
+    if (header.little_endian != expected.little_endian) throw std::runtime_error{ "Record file has the wrong byte order." };
+    if (header.record_size != expected.record_size || header.record_align != expected.record_align)
+        throw std::runtime_error{ "Record file has a different layout." };
+    if (header.schema != expected.schema) throw std::runtime_error{ "Record file has a different schema." };
+}
+
+// Same as ch6/11, plus write_all and read_all.
+struct File {
+    File(const char* path, int flags, mode_t mode = 0644)
+        : fd{ open(path, flags, mode) } {
+        if (fd < 0) throw std::runtime_error{ "Cannot open file." };
+    }
+    ~File() { close(fd); }
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+
+    size_t size() const {
+        struct stat st;
+        if (fstat(fd, &st) != 0) throw std::runtime_error{ "Cannot stat file." };
+        return static_cast<size_t>(st.st_size);
+    }
+    void write_all(const void* data, size_t bytes, size_t at) const {
+        auto in = static_cast<const char*>(data);
+        while (bytes > 0) {
+            const ssize_t written = pwrite(fd, in, bytes, static_cast<off_t>(at));
+            if (written <= 0) throw std::runtime_error{ "write failed." };
+            in += written;
+            at += static_cast<size_t>(written);
+            bytes -= static_cast<size_t>(written);
+        }
+    }
+    void read_all(void* data, size_t bytes, size_t at) const {
+        auto out = static_cast<char*>(data);
+        while (bytes > 0) {
+            const ssize_t got = pread(fd, out, bytes, static_cast<off_t>(at));
+            if (got <= 0) throw std::runtime_error{ "read failed." };
+            out += got;
+            at += static_cast<size_t>(got);
+            bytes -= static_cast<size_t>(got);
+        }
+    }
+    int fd;
+};
+
+// Same as ch6/11.
+struct TemporaryFile {
+    explicit TemporaryFile(const char* prefix)
+        : path{ std::string{ "/tmp/" } + prefix + "_XXXXXX" } {
+        const int fd = mkstemp(path.data());
+        if (fd < 0) throw std::runtime_error{ "Cannot create temporary file." };
+        close(fd);
+    }
+    ~TemporaryFile() { unlink(path.c_str()); }
+    TemporaryFile(const TemporaryFile&) = delete;
+    TemporaryFile& operator=(const TemporaryFile&) = delete;
+    std::string path;
+};
+
+// One write for the header, one for all records, then flush to the disk.
+template <Serializable T>
+void write_records(const char* path, std::span<const T> records) {
+    File out{ path, O_WRONLY | O_CREAT | O_TRUNC };
+    const RecordFileHeader header = header_for<T>(records.size());
+    char padded[records_offset]{};
+    std::memcpy(padded, &header, sizeof(header));
+    out.write_all(padded, sizeof(padded), 0);
+    out.write_all(records.data(), records.size_bytes(), records_offset);
+    if (fdatasync(out.fd) != 0) throw std::runtime_error{ "fdatasync failed." };
+}
+
+template <Serializable T>
+std::vector<T> read_records(const char* path) {
+    File in{ path, O_RDONLY };
+    RecordFileHeader header;
+    in.read_all(&header, sizeof(header), 0);
+    check_header<T>(header);
+    if (in.size() < records_offset || header.count > (in.size() - records_offset) / sizeof(T))
+        throw std::runtime_error{ "Record file is truncated." };
+    std::vector<T> records(header.count);
+    in.read_all(records.data(), header.count * sizeof(T), records_offset);
+    return records;
+}
+
+// The records used in place, no copy at all.
+template <Serializable T>
+class MappedRecords {
+public:
+    explicit MappedRecords(const char* path) {
+        File in{ path, O_RDONLY };
+        map_size = in.size();
+        if (map_size < records_offset) throw std::runtime_error{ "Not a record file." };
+        map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, in.fd, 0);
+        if (map == MAP_FAILED) throw std::runtime_error{ "mmap failed." };
+        const auto& header = *static_cast<const RecordFileHeader*>(map);
+        try {
+            check_header<T>(header);
+            if (header.count > (map_size - records_offset) / sizeof(T)) throw std::runtime_error{ "Record file is truncated." };
+        } catch(...) {
+            munmap(map, map_size);
+            throw;
+        }
+        records = { reinterpret_cast<const T*>(static_cast<const char*>(map) + records_offset), header.count };
+    }
+    ~MappedRecords() { munmap(map, map_size); }
+    MappedRecords(const MappedRecords&) = delete;
+    MappedRecords& operator=(const MappedRecords&) = delete;
+
+    std::span<const T> get() const { return records; }
+
+private:
+    void* map;
+    size_t map_size;
+    std::span<const T> records;
+};
+
+// The old way: every field with its own fwrite / fread.
+void write_field_by_field(const char* path, std::span<const PodStruct> records) {
+    std::FILE* file = std::fopen(path, "wb");
+    if (!file) throw std::runtime_error{ "Cannot open file." };
+    const uint64_t count = records.size();
+    std::fwrite(&count, sizeof(count), 1, file);
+    for (const auto& record : records) {
+        std::fwrite(&record.number, sizeof(record.number), 1, file);
+        std::fwrite(record.string, sizeof(record.string), 1, file);
+        std::fwrite(&record.valid, sizeof(record.valid), 1, file);
+    }
+    std::fflush(file);
+    fdatasync(fileno(file));
+    std::fclose(file);
+}
+
+std::vector<PodStruct> read_field_by_field(const char* path) {
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) throw std::runtime_error{ "Cannot open file." };
+    uint64_t count{};
+    if (std::fread(&count, sizeof(count), 1, file) != 1) count = 0;
+    std::vector<PodStruct> records(count);
+    for (auto& record : records) {
+        if (std::fread(&record.number, sizeof(record.number), 1, file) != 1 ||
+            std::fread(record.string, sizeof(record.string), 1, file) != 1 ||
+            std::fread(&record.valid, sizeof(record.valid), 1, file) != 1) {
+            std::fclose(file);
+            throw std::runtime_error{ "Record file is truncated." };
+        }
+    }
+    std::fclose(file);
+    return records;
+}
+
+// Not trivially copyable: the std::string holds a pointer to its characters.
+struct Named {
+    uint64_t number;
+    std::string name;
+};
+static_assert(Serializable<PodStruct>);
+static_assert(!Serializable<Named>);
+// write_records<Named>("named.bin", {});  // Bang! constraints not satisfied
+
+template <typename F>
+double seconds(F&& f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t checksum(std::span<const PodStruct> records) {
+    uint64_t total{};
+    for (const auto& record : records) total += record.number + record.valid + static_cast<unsigned char>(record.string[0]);
+    return total;
+}
+
+int main(int argc, char** argv) {
+    printf("PodStruct: %zu bytes, schema hash %016llx\n", sizeof(PodStruct),
+           static_cast<unsigned long long>(schema_hash<PodStruct>()));
+
+    // A record file named on the command line is only read.
+    if (argc > 1 && std::strcmp(argv[1], "-n") != 0) {
+        try {
+            const MappedRecords<PodStruct> mapped{ argv[1] };
+            const std::vector<PodStruct> copied = read_records<PodStruct>(argv[1]);
+            printf("%s: %zu records, checksum %llu (%s)\n", argv[1], copied.size(),
+                   static_cast<unsigned long long>(checksum(copied)),
+                   checksum(copied) == checksum(mapped.get()) ? "read and mapped agree" : "MISMATCH");
+        } catch(const std::runtime_error& e) {
+            printf("Exception: %s\n", e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    // Everything else, including the damage at the end, uses a private file.
+    const TemporaryFile temporary{ "pod_records" };
+    const char* path = temporary.path.c_str();
+    const size_t n = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2'000'000;
+
+    std::vector<PodStruct> records(n);
+    for (size_t i{}; i < n; i++) {
+        records[i].number = i;
+        snprintf(records[i].string, sizeof(records[i].string), "Hello World %zu", i);
+        records[i].valid = i % 2 == 0;
+    }
+    const double mb = n * sizeof(PodStruct) / 1e6;
+    const uint64_t expected = checksum(records);
+
+    const double t_write_fields = seconds([&] { write_field_by_field(path, records); });
+    std::vector<PodStruct> by_field;
+    const double t_read_fields = seconds([&] { by_field = read_field_by_field(path); });
+    by_field = {};
+
+    const double t_write_bulk = seconds([&] { write_records<PodStruct>(path, records); });
+    std::vector<PodStruct> bulk;
+    const double t_read_bulk = seconds([&] { bulk = read_records<PodStruct>(path); });
+    uint64_t mapped_sum{};
+    const double t_mmap = seconds([&] {
+        const MappedRecords<PodStruct> mapped{ path };
+        mapped_sum = checksum(mapped.get());
+    });
+
+    printf("\n=== %zu records, %.0f MB (writes include fdatasync; reads from the page cache) ===\n", n, mb);
+    printf("write field by field: %8.1f MB/s\n", mb / t_write_fields);
+    printf("write one block:      %8.1f MB/s\n", mb / t_write_bulk);
+    printf("read field by field:  %8.1f MB/s\n", mb / t_read_fields);
+    printf("read one block:       %8.1f MB/s  %s\n", mb / t_read_bulk, checksum(bulk) == expected ? "ok" : "MISMATCH");
+    printf("mmap + scan:          %8.1f MB/s  %s\n", mb / t_mmap, mapped_sum == expected ? "ok" : "MISMATCH");
+
+    // A reader with a different layout refuses the file. Renaming `number` to
+    // `id` would change the schema hash; here we fake that by flipping a bit.
+    {
+        File file{ path, O_RDWR };
+        RecordFileHeader header;
+        file.read_all(&header, sizeof(header), 0);
+        header.schema ^= 1;
+        file.write_all(&header, sizeof(header), 0);
+    }
+    try {
+        read_records<PodStruct>(path);
+    } catch(const std::runtime_error& e) {
+        printf("\nException: %s\n", e.what());
+    }
+    // A file cut off inside the padding after the header.
+    write_records<PodStruct>(path, std::span{ records }.first(1));
+    if (truncate(path, sizeof(RecordFileHeader)) != 0) printf("Could not truncate %s\n", path);
+    try {
+        read_records<PodStruct>(path);
+    } catch(const std::runtime_error& e) {
+        printf("Exception: %s\n", e.what());
+    }
+}
+
+/* TAKEAWAY
+* Field by field, the time goes into millions of small library calls, not into
+* the disk. One large write or read is limited only by the device (or by memcpy
+* from the page cache), and mmap skips even that copy.
+*/
@@ -19,7 +19,7 @@
 /*
 * You can see that template T needs to satisfy three requirments.
 * 1. T must be 'default constructible'.
-* 2. T supports += operator.
+* 2. T supports += operator (which, like for built-in types, yields T&).
 * 3. Dividing T by size_t yields a T.
 */
 
@@ -27,7 +27,7 @@
 template <typename T>
 concept Averagable =  std::is_default_constructible_v<T>
     && requires (T a, T b) {  // define as many parameters as you need for checks.
-        { a += b } -> std::same_as<T>;
+        { a += b } -> std::same_as<T&>;  // compound assignment returns a reference
         { a / size_t{ 1 }} -> std::same_as<T>;  // requires fields can have any subset of the parameters
     };
 
@@ -13,7 +13,7 @@
 template <typename T>
 T& get(T (&arr)[10], size_t index) {  // has an reference array as parameter, but
   // we have to specify the length and check for out-of-range, lacking genericity.
-    if (index > 10) throw std::out_of_range("Out of Bounds.");
+    if (index >= 10) throw std::out_of_range("Out of Bounds.");
     return arr[index];
 }
 
@@ -0,0 +1,144 @@
+/* Parallel mean
+* The `mean` template from ch6/1 walks the array with one thread. For arrays with
+* hundreds of millions of elements the loop is bound by memory bandwidth, and a
+* single core cannot pull enough bytes out of memory to saturate it.
+*
+* Here the same template is split into fixed-size chunks. A handful of worker
+* threads grab chunks from a shared atomic counter (a tiny 'thread pool' that
+* lives for the duration of one call) and write one partial sum per chunk.
+* The partial sums are then added up in chunk order by the calling thread.
+*
+* Why fixed-size chunks and not "one slice per thread"? Because then the result
+* does not depend on how many threads you use: the same chunks are summed in the
+* same order every time -> deterministic result, even for float/double where
+* (a+b)+c != a+(b+c).
+*
+* Why `alignas(64)`? Neighbouring partial sums written by different threads
+* would otherwise share one cache line and the cores keep stealing that line
+* from each other ('false sharing'). Padding every slot to its own line avoids it.
+*
+* Overflow: for size_t the sequential version silently wraps around (unsigned
+* arithmetic is modulo 2^64). Adding partial sums also wraps modulo 2^64, so the
+* parallel version gives exactly the same (possibly wrapped) result.
+*
+* compile: `g++ -std=c++20 -O2 -pthread 9_parallel_mean.cpp -o parallel_mean`
+* run:     `./parallel_mean [n_elements]`
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// Same as ch6/1.
+template <typename T>
+T mean(const T* values, size_t length) {
+    T result{};
+    for(size_t i{}; i < length; i++) {
+        result += values[i];
+    }
+    return result/length;
+}
+
+// One partial sum per cache line.
+template <typename T>
+struct alignas(64) PaddedSum {
+    T value{};
+};
+
+// 64K elements per chunk: large enough that grabbing a chunk is cheap compared
+// to summing it, small enough that the work balances between threads.
+constexpr size_t default_chunk_size{ 1 << 16 };
+
+// Overload of `mean` taking the number of worker threads. n_threads == 0 means
+// "use std::thread::hardware_concurrency()".
+template <typename T>
+T mean(const T* values, size_t length, unsigned n_threads,
+       size_t chunk_size = default_chunk_size) {
+    if (n_threads == 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (chunk_size == 0) chunk_size = default_chunk_size;
+    const size_t n_chunks = (length + chunk_size - 1) / chunk_size;
+    std::vector<PaddedSum<T>> partials(n_chunks);
+    std::atomic<size_t> next_chunk{};
+
+    auto worker = [&] {
+        for (size_t c = next_chunk++; c < n_chunks; c = next_chunk++) {
+            const size_t begin = c * chunk_size;
+            const size_t end = std::min(begin + chunk_size, length);
+            T sum{};  // accumulate in a register, write the slot only once
+            for (size_t i{ begin }; i < end; i++) sum += values[i];
+            partials[c].value = sum;
+        }
+    };
+
+    const unsigned n_workers = static_cast<unsigned>(
+        std::min<size_t>(n_threads, std::max<size_t>(n_chunks, 1)));
+    std::vector<std::thread> pool;
+    pool.reserve(n_workers - 1);
+    for (unsigned t{ 1 }; t < n_workers; t++) pool.emplace_back(worker);
+    worker();  // the calling thread does its share as well
+    for (auto& thread : pool) thread.join();
+
+    // Deterministic reduction: always in chunk order.
+    T result{};
+    for (const auto& partial : partials) result += partial.value;
+    return result/length;
+}
+
+template <typename T>
+double time_mean_ms(const std::vector<T>& data, unsigned n_threads, T& out) {
+    const auto start = std::chrono::steady_clock::now();
+    out = mean(data.data(), data.size(), n_threads);
+    const auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Thread counts for a scaling curve: 1, 2, 4, ... below max_threads, then max_threads.
+std::vector<unsigned> thread_counts(unsigned max_threads) {
+    std::vector<unsigned> counts;
+    for (unsigned t{ 1 }; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+int main(int argc, char** argv) {
+    const double nums_d[] { 1.0, 2.0, 3.0, 4.0 };
+    printf("double: %f\n", mean(nums_d, 4, 2));
+    const size_t nums_c[] { 1, 2, 3, 4 };
+    printf("size_t: %zu\n", mean(nums_c, 4, 2));
+
+    // size_t overflow wraps the same way as the sequential loop.
+    const size_t huge[] { static_cast<size_t>(-1), static_cast<size_t>(-1), 4, 6 };
+    printf("size_t overflow: sequential %zu, parallel %zu\n",
+           mean(huge, 4), mean(huge, 4, 4, 1));
+
+    // Scaling curve: 1 .. N threads over a large array.
+    const size_t n = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : size_t{ 1 } << 26;
+    std::vector<double> data(n);
+    for (size_t i{}; i < n; i++) data[i] = static_cast<double>(i % 1000);
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    printf("\n=== scaling, %zu doubles (%.0f MB) ===\n", n, n * sizeof(double) / 1e6);
+    double sequential{};
+    const auto start = std::chrono::steady_clock::now();
+    sequential = mean(data.data(), data.size());
+    const auto stop = std::chrono::steady_clock::now();
+    const double base_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    printf("sequential: %8.2f ms  %6.2f GB/s  mean=%f\n",
+           base_ms, n * sizeof(double) / base_ms / 1e6, sequential);
+    for (unsigned t : thread_counts(max_threads)) {
+        double result{};
+        const double ms = time_mean_ms(data, t, result);
+        printf("%2u threads: %8.2f ms  %6.2f GB/s  speedup %.2fx  mean=%f\n",
+               t, ms, n * sizeof(double) / ms / 1e6, base_ms / ms, result);
+    }
+}
+
+/* TAKEAWAY
+* Expect the speedup to flatten out once the memory bus is saturated, usually
+* well before you run out of cores. Past that point more threads do not help,
+* only reading fewer bytes does.
+*/